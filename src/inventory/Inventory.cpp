@@ -4,25 +4,194 @@
 #include <cerrno>
 #include <cctype>
 #include <cmath>
+#include <cfloat>
+#include <climits>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <strings.h>
+#include <locale.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/resource.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stddef.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
 
 #define MAX_STRING_LEN (0x03ff)
 #define MAX_BUFFER_SIZE (MAX_STRING_LEN + 1)
 #define HASH ((size_t) 0xffff20240feb0025)
+#define REGION_CHUNK_SIZE (0x00200000)
+#define REGION_ALIGN (16)
+#define POOL_HASH ((size_t) 0xffff20240feb0027)
+#define POOL_FREE_HASH ((size_t) 0xffff20240feb0028)
+#define POOL_CLASSES (4)
+#define POOL_MIN_OBJECT (16)
+#define POOL_MAX_OBJECT (POOL_MIN_OBJECT << (POOL_CLASSES - 1))
+#define POOL_SLAB_SIZE (0x00004000)
+#define IMPORT_BLOCK_SIZE (0x00100000)
+#define IMPORT_ROWS (IMPORT_BLOCK_SIZE / 32)
+#define BLOCK_FREE (0)
+#define BLOCK_READY (1)
+#define BLOCK_DONE (2)
+#define NPOS ((size_t) -1)
+#define BTREE_ORDER (64)
+#define SNAPSHOT_MAGIC "INVSNAP"
+#define SNAPSHOT_VERSION (3)
+#define SNAPSHOT_ENDIAN (0x01020304)
+#define SNAPSHOT_ALIGN (64)
+#define SNAPSHOT_SECTIONS (9)
+#define DIFF_BATCH (16)
+#define ARROW_MAGIC "ARROW1"
+#define ARROW_ALIGN (8)
+#define ARROW_META_SIZE (0x00001000)
+#define ARROW_BUFFER_SIZE (0x00100000)
+#define ARROW_FIELDS (10)
+#define ARROW_BUFFERS (23)		// validity and data, plus offsets for the strings
+#define ARROW_SLOTS (6)			// most fields of the tables that are written
+#define ARROW_V5 (4)			// MetadataVersion
+#define ARROW_SCHEMA (1)		// MessageHeader
+#define ARROW_RECORD_BATCH (3)
+#define ARROW_FLOAT (3)			// Type
+#define ARROW_BOOL (6)
+#define ARROW_LARGE_UTF8 (20)
+#define ARROW_DOUBLE (2)		// Precision
+#define JOURNAL_MAGIC "INVWAL"
+#define JOURNAL_VERSION (2)
+#define JOURNAL_BUFFER_SIZE (0x00400000)
+#define JOURNAL_WINDOW_MS (10)
+#define JOURNAL_COMPACT_MB (64)
+#define PARSE_MAX_DIGITS (19)
+#define PARSE_MAX_EXACT (22)
+#define BENCH_NUMBERS (0x00100000)
+#define BENCH_ITEMS (1000000)
+#define BENCH_REPEAT (5)
+#define BENCH_SEED (1)
+#define SELFTEST_LENGTHS (512)	// every length up to it is checked
+#define SELFTEST_OFFSETS (4)
+#define WRITER_BUFFER_SIZE (0x00010000)
+#define READER_BUFFER_SIZE (0x00010000)
+#define AGG_CHUNK (0x00004000)
+#define KINDS (8)		// most pricing tiers, the kinds are labeled from A on
+#define HIST_BUCKETS (10)
+#define HIST_WIDTH (10.0e3)
+#define RECORD_UPSERT (0)
+#define RECORD_ERASE (1)
+#define RECORD_REPRICE (2)
+#define M_TAGS (8)
+#define M_TAG_SHIFT (56)
+#define M_SIZE_MASK ((((size_t) 1) << M_TAG_SHIFT) - 1)
+#define M_CLASSES (24)
+#define M_REPORT_SIZE (0x00001000)
+
+struct m_heap_s;
 
 typedef struct m_chain_s {
 	struct m_chain_s *prev;
 	struct m_chain_s *next;
 	void *data;
+	struct m_heap_s *heap;	// owner, rewritten when the heap of an exiting thread is merged
 	size_t hash;
 	size_t size;
 } m_chain_t;
 
+// header of the pooled objects, aliases the tail of m_chain_t
+typedef struct {
+	size_t hash;
+	size_t size;
+} m_head_t;
+
+// free slot of a pool, the link overlays the payload
+typedef struct m_slot_s {
+	m_head_t head;
+	struct m_slot_s *next;
+} m_slot_t;
+
+// chunks are aligned to their size so that an object finds the heap that owns it by masking
+typedef struct m_region_s {
+	struct m_region_s *next;
+	struct m_heap_s *heap;
+	size_t size;
+} m_region_t;
+
+// type of the allocated object, kept in the top byte of the size in its header
 typedef enum {
+	M_OTHER,
+	M_ITEM,
+	M_KIND,
+	M_STACK,
+	M_STRING,
+	M_NUMBER,
+	M_INDEX,
+	M_BUFFER,
+} m_tag_t;
+
+// allocation telemetry, the counters describe the live objects unless stated otherwise
+typedef struct {
+	size_t peak;			// high-water mark of the allocated bytes
+	size_t allocations;		// made since startup
+	size_t headers;			// bytes taken by the headers of the objects
+	size_t objects[M_TAGS];
+	size_t bytes[M_TAGS];
+	size_t classes[M_CLASSES];	// objects by the power of two (from 16) that bounds their size
+} m_stats_t;
+
+// allocator state of a thread, only the owner touches it except for the remote free list
+typedef struct m_heap_s {
+	m_chain_t chain;
+	m_region_t *region;	// chunks of the region
+	char *avail;		// bump pointer into the most recent chunk
+	char *limit;
+	m_slot_t *pool[POOL_CLASSES];	// free lists of the size classes 16, 32, 64, 128
+	size_t size;
+	size_t count;
+	m_stats_t stats;
+	std::atomic<void*> remote;	// objects freed by other threads, linked through their payload
+	struct m_heap_s *next;		// registry of the heaps
+	struct m_heap_s *link;		// idle heaps
+} m_heap_t;
+
+// kinds of the built-in tiers (A to C), the tiers of a pricing file take the kinds in order up
+// to KINDS, the kernels store them as 32-bit integers
+typedef enum kind_e : int32_t {
 	A,
 	B,
 	C,
+	D,
+	E,
+	F,
+	G,
+	H
 } kind_t;
 
+static_assert(H + 1 == KINDS, "a kind for every pricing tier");
+
+/*
+
+tier k takes the costs in (threshold[k - 1], threshold[k]] and sells them at (1 + markup[k])
+times the cost, the thresholds ascend and the unused ones are +inf so that the tier of a cost
+is just the number of thresholds under it
+
+*/
+typedef struct {
+	double threshold[KINDS];
+	double markup[KINDS];
+	size_t tiers;
+	bool builtin;		// the tiers are the built-in ones, band() uses its specialization
+} pricing_t;
+
 struct Kind
 {
 	kind_t kind;
@@ -34,6 +203,41 @@ struct Kind
 	void operator delete(void *p);
 };
 
+// reads the input a block at a time and hands out its lines as views into the block, a view is
+// valid until the next line is read
+struct Reader
+{
+	char *_buffer_ = NULL;
+	size_t _size_ = 0;
+	size_t _head_ = 0;		// start of the next line
+	size_t _used_ = 0;		// bytes read into the buffer
+	int _fd_ = STDIN_FILENO;
+	int open(int fd, size_t size);
+	ssize_t line(char **text);
+	void *operator new(size_t size);
+	void operator delete(void *p);
+};
+
+// renders the reports into a buffer that is written out when full or flushed
+struct Writer
+{
+	char *_buffer_ = NULL;
+	size_t _used_ = 0;
+	size_t _size_ = 0;
+	int _fd_ = STDOUT_FILENO;
+	int _error_ = 0;		// errno of a failed write
+	int open(int fd, size_t size);
+	Writer &bytes(const void *data, size_t len);
+	Writer &text(const char *str);
+	Writer &put(char c);
+	Writer &fixed(double x, int prec);
+	Writer &field(const char *label, double x, int prec);
+	Writer &field(const char *label, const char *str);
+	int flush();
+	void *operator new(size_t size);
+	void operator delete(void *p);
+};
+
 struct Item
 {
 	char *code = NULL;
@@ -59,33 +263,401 @@ struct Item
 	void operator delete(void *p);
 };
 
+// stores the elements by value in a buffer that grows geometrically
+template<typename T>
 struct Stack
 {
-	void **_stack_ = NULL;
-	void **_begin_ = NULL;
-	void **_avail_ = NULL;
-	void **_limit_ = NULL;
-	size_t _allot_ = 8;
-	size_t _size_ = 0;
-	int init();
-	void *copy() const;
-	size_t bytes () const;
-	int grow();
+	T *_begin_ = NULL;
+	T *_avail_ = NULL;
+	T *_limit_ = NULL;
+	bool _borrowed_ = false;	// the buffer is owned by someone else, a mapped snapshot
+	int grow(size_t numel);
+	int relocate(size_t allot);
 	Stack(void);
+	Stack(Stack &&stack);
+	Stack(const Stack &stack) = delete;
+	~Stack();
+	Stack &operator=(Stack &&stack);
+	Stack &operator=(const Stack &stack) = delete;
 	size_t cap() const;
 	size_t numel() const;
-	int add(void *elem);
-	void **begin();
-	void **end();
+	size_t bytes() const;
+	int reserve(size_t allot);
+	int shrink_to_fit();
+	int add(const T &elem);
+	int add(T &&elem);
+	int append(const T *elems, size_t numel);
+	void pop();
+	void borrow(T *elems, size_t numel);
+	void clear();
+	T *begin();
+	T *end();
+	const T *begin() const;
+	const T *end() const;
+	T &operator[](size_t i);
+	const T &operator[](size_t i) const;
+	void *operator new(size_t size);
+	void operator delete(void *p);
+};
+
+typedef struct {
+	size_t hash;	// zero marks an empty slot
+	size_t row;
+} slot_t;
+
+// compensated sum, the compensation carries the low-order bits that the sum loses
+typedef struct {
+	double sum;
+	double comp;
+} ksum_t;
+
+// statistics of a group of items, the histogram counts the items by unit cost
+typedef struct {
+	size_t items;
+	double units;
+	double cost;		// units * cost
+	double sale;		// units * sale
+	double min_cost;
+	double max_cost;
+	double sum_cost;	// of the unit costs, for the mean
+	size_t hist[HIST_BUCKETS];
+} group_t;
+
+// row of an import, the strings point into the block that holds the line
+typedef struct {
+	const char *code;
+	const char *info;
+	size_t code_len;
+	size_t info_len;
+	double size;
+	double cost;
+	double sale;
+	double count;
+	const char *reason;	// why the row is rejected, NULL if it is accepted
+	size_t line;		// of the block
+	kind_t kind;
+	char avail;
+} row_t;
+
+// whole lines of an import and the rows parsed out of them
+typedef struct {
+	char *data;
+	size_t bytes;		// of whole lines
+	size_t done;		// bytes parsed so far
+	size_t lines;		// lines parsed so far
+	row_t *rows;
+	size_t numel;		// rows parsed so far, accepted or rejected
+	bool oversize;		// stands for a line that does not fit in a block
+	std::atomic<size_t> state;	// sequence number of the block and its phase, seq << 2 | phase
+} iblock_t;
+
+// state of an import shared by the reader, the parsers and the committer
+typedef struct {
+	int fd;
+	int error;		// errno of a failed read
+	char delim;
+	bool eof;
+	bool skip;		// discards the rest of a line that does not fit in a block
+	char *carry;		// partial line at the end of the last block
+	size_t held;		// bytes in the carry
+	iblock_t *blocks;
+	size_t slots;
+	std::atomic<size_t> next;	// next block to parse
+	std::atomic<size_t> total;	// number of blocks, NPOS until the reader is done
+} importer_t;
+
+// running totals of the items of a kind
+typedef struct {
+	ksum_t profit;		// units * (sale - cost)
+	ksum_t expenses;	// units * cost
+	ksum_t units;
+} totals_t;
+
+// Robin Hood hash index of the rows by reference code, keys are kept in the string heap
+struct CodeIndex
+{
+	slot_t *_slots_ = NULL;
+	size_t _mask_ = 0;
+	size_t _numel_ = 0;
+	int rehash(size_t allot);
+	void place(slot_t slot);
+	CodeIndex(void);
+	size_t numel() const;
+	size_t bytes() const;
+	int reserve(size_t numel);
+	size_t find(const char *code,
+		    size_t hash,
+		    const char *heap,
+		    const size_t *codes) const;
+	int insert(size_t hash, size_t row);
+	int erase(size_t hash, size_t row);
+	int relink(size_t hash, size_t row, size_t dest);
+	void clear();
+	void *operator new(size_t size);
+	void operator delete(void *p);
+};
+
+// node of the B+ tree, the arrays have room for the entry that overflows the node before a split
+typedef struct bnode_s {
+	size_t numel;
+	bool leaf;
+	struct bnode_s *prev;		// sibling leaves are linked for ordered scans
+	struct bnode_s *next;
+	double keys[BTREE_ORDER + 1];
+	size_t rows[BTREE_ORDER + 1];	// entries are ordered by key and then by row
+	struct bnode_s *child[BTREE_ORDER + 2];
+} bnode_t;
+
+typedef struct {
+	bnode_t *leaf;			// NULL past either end
+	size_t pos;
+} cursor_t;
+
+// B+ tree of the rows ordered by a numeric column, erased entries leave underfull leaves behind
+struct OrderedIndex
+{
+	bnode_t *_root_ = NULL;
+	bnode_t *_head_ = NULL;
+	bnode_t *_tail_ = NULL;
+	size_t _numel_ = 0;
+	size_t _nodes_ = 0;
+	bnode_t *node(bool leaf);
+	int insertAt(bnode_t *node,
+		     double key,
+		     size_t row,
+		     bnode_t **right,
+		     double *sep_key,
+		     size_t *sep_row);
+	OrderedIndex(void);
+	size_t numel() const;
+	size_t bytes() const;
+	int insert(double key, size_t row);
+	int erase(double key, size_t row);
+	cursor_t lower(double key) const;
+	void clear();
+	cursor_t first() const;
+	cursor_t last() const;
+	void next(cursor_t *cursor) const;
+	void prev(cursor_t *cursor) const;
+	void *operator new(size_t size);
+	void operator delete(void *p);
+};
+
+/*
+
+Snapshot Format
+
+header | cost | sale | count | size | kind | avail | code | info | heap
+
+The sections hold the columns of the item store in the byte order of the writer and start at
+offsets aligned to SNAPSHOT_ALIGN bytes so that a mapping of the file backs the columns as is.
+The code and info sections hold the offsets of the strings into the heap. The header carries the
+running totals by kind, its checksum is verified on every load and the checksum of the sections
+on demand (--verify) so that the restart time does not depend on the number of items. The kinds
+and the string offsets of the rows are checked as the rows are read.
+
+*/
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t endian;
+	uint64_t numel;
+	uint64_t heap;				// size of the string heap in bytes
+	uint64_t offset[SNAPSHOT_SECTIONS];	// cost, sale, count, size, kind, avail, code, info, heap
+	uint64_t size;				// size of the file in bytes
+	uint64_t lsn;				// last journal record applied to the items
+	totals_t totals[KINDS];			// running totals of the items by kind
+	uint64_t checksum;			// of the sections
+	uint64_t hchecksum;			// of the header up to this field
+} snapshot_t;
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t endian;
+} journal_t;
+
+// journal record, the reference code and the description follow it without terminators, a
+// repricing keeps its range in cost and sale and the pricing in effect in place of the description
+typedef struct {
+	uint32_t bytes;		// of the record
+	uint32_t check;		// checksum of the record past this field
+	uint64_t lsn;
+	double size;
+	double cost;
+	double sale;
+	double count;
+	uint32_t kind;
+	uint16_t code;		// length of the reference code
+	uint16_t info;		// length of the description
+	char avail;
+	char op;		// RECORD_UPSERT, RECORD_ERASE or RECORD_REPRICE
+	char pad[6];
+} record_t;
+
+/*
+
+Arrow Export
+
+magic | schema message | record batch message | body | end of stream | footer | size | magic
+
+The export is an Arrow IPC file (Feather V2) of a single record batch, so that it can be mapped
+and read as is by the Arrow libraries. A message is framed by a continuation marker and the size
+of its flatbuffer, the body follows the record batch message and holds the buffers of the columns
+at offsets aligned to ARROW_ALIGN bytes. The columns are code, description, size, available,
+cost, sale, count, kind, total_cost and net_profit, none of them has nulls. The flatbuffers are
+built back to front as the flatbuffers library does, the numbers of the columns are in the byte
+order of the writer and the schema tells which one it is.
+
+*/
+
+// flatbuffer built back to front, the offsets of the objects are taken from its end
+typedef struct {
+	uint8_t data[ARROW_META_SIZE];
+	size_t head;			// the bytes built so far are data[head, ARROW_META_SIZE)
+	size_t minalign;
+	size_t start;			// size at the start of the open table
+	size_t slots;			// of the open table
+	size_t field[ARROW_SLOTS];	// size past each field of the open table, zero if absent
+} fbuilder_t;
+
+// columns of a snapshot compared by diff()
+typedef struct {
+	void *map;
+	size_t size;		// of the mapping
+	size_t numel;
+	size_t bytes;		// of the string heap
+	const char *path;
+	const char *heap;
+	const size_t *code;
+	const double *cost;
+	const double *sale;
+	const double *count;
+} dside_t;
+
+/*
+
+Journal
+
+The items accepted during a session are appended to the journal before they are acknowledged.
+The records fill one of two buffers while a committer thread writes and syncs the other one,
+waking up once per commit window (or as soon as a buffer fills) so that the records that
+arrive within a window share a single fdatasync(). Acknowledging a record waits until the
+record is durable. Records carry log sequence numbers so that the records that a snapshot
+already holds are skipped on replay, and a torn record at the tail is discarded.
+
+*/
+
+struct Journal
+{
+	int _fd_ = -1;
+	char *_buffer_[2] = {NULL, NULL};
+	int _active_ = 0;		// buffer that takes the new records
+	size_t _used_ = 0;
+	bool _full_ = false;
+	bool _stop_ = false;
+	int _error_ = 0;		// errno of a failed write or sync
+	uint64_t _lsn_ = 0;		// last record appended
+	uint64_t _durable_ = 0;		// last record on disk
+	size_t _size_ = 0;		// size of the journal file
+	std::chrono::milliseconds _window_;
+	std::mutex _lock_;
+	std::condition_variable _wake_;	// wakes up the committer
+	std::condition_variable _done_;	// signals the progress of the committer
+	std::thread _committer_;
+	void commit();
+	uint64_t push(record_t *record, const char *code, size_t code_len, const char *info, size_t info_len);
+	Journal(void);
+	int open(const char *path, uint64_t lsn, size_t size, long window);
+	uint64_t append(const char *code,
+			const char *info,
+			char avail,
+			double size,
+			double cost,
+			double sale,
+			double count,
+			kind_t kind,
+			char op = RECORD_UPSERT);
+	uint64_t reprice(const pricing_t *pricing, double lo, double hi);
+	void ack(uint64_t lsn);
+	size_t bytes();
+	int truncate();
+	void close();
+	void *operator new(size_t size);
+	void operator delete(void *p);
+};
+
+// columnar item store, the Item is just a view of one of its rows
+struct ItemTable
+{
+	Stack<double> _cost_;
+	Stack<double> _sale_;
+	Stack<double> _count_;
+	Stack<double> _size_;
+	Stack<Kind> _kind_;
+	Stack<char> _avail_;
+	Stack<size_t> _code_;		// offsets of the reference codes into the string heap
+	Stack<size_t> _info_;		// offsets of the descriptions into the string heap
+	Stack<char> _heap_;
+	CodeIndex _index_;
+	OrderedIndex _by_cost_;
+	OrderedIndex _by_sale_;
+	OrderedIndex _by_profit_;	// by unit profit, sale - cost
+	totals_t _totals_[KINDS] = {};	// kept up to date on every add, update and delete
+	group_t _groups_[2 * KINDS] = {};	// of the folded items, the stored ones are grouped by a scan
+	size_t _folded_ = 0;		// items counted in the totals and the groups but not stored
+	size_t _numel_ = 0;
+	uint64_t _lsn_ = 0;		// last journal record applied to the items
+	bool _indexed_ = true;		// false until the indexes of attached rows are built
+	bool _priced_ = true;		// false until the sale and profit indexes follow a repricing
+	int reserve(size_t allot);
+	int shrink_to_fit();
+	ItemTable(void);
+	size_t numel() const;
+	size_t bytes() const;
+	int add(const char *code,
+		const char *info,
+		char avail,
+		double size,
+		double cost,
+		double sale,
+		double count,
+		kind_t kind);
+	int upsert(const char *code,
+		   const char *info,
+		   char avail,
+		   double size,
+		   double cost,
+		   double sale,
+		   double count,
+		   kind_t kind,
+		   size_t *row);
+	int erase(size_t i);
+	size_t find(const char *code);
+	void account(size_t i, double sign);
+	void fold(double cost, double sale, double count, kind_t kind, char avail);
+	void totals(double *profit, double *expenses, double *units) const;
+	int index();
+	void attach(const snapshot_t *snapshot, char *base);
+	char *text(size_t offset);
+	Item row(size_t i);
 	void *operator new(size_t size);
 	void operator delete(void *p);
 };
 
-static m_chain_t _m_chain_ ;
-static size_t _m_size_ = 0;
-static size_t _m_count_ = 0;
+static m_heap_t _m_main_;		// heap of the first thread that allocates
+static m_heap_t _m_orphan_;		// objects of the exited threads, guarded by _m_lock_
+static __thread m_heap_t *_m_local_ = NULL;
+static std::atomic<m_heap_t*> _m_heaps_(NULL);	// registry, heaps are never unmapped
+static m_heap_t *_m_idle_ = NULL;	// heaps of the exited threads ready for reuse
+static std::mutex _m_lock_;
+static pthread_key_t _m_key_;		// detaches the heap when its thread exits
+static pthread_once_t _m_once_ = PTHREAD_ONCE_INIT;
+static const char *_m_tags_[M_TAGS] = {
+	"other", "item", "kind", "stack", "string", "number", "index", "buffer"
+};
 
-static size_t _sz_ = 0;		// size of temporary placeholder
 static char *_temp_[] = {NULL};	// temporary placeholder for fetching the entire line
 static char *_code_[] = {NULL};	// shoe reference code could be alpha numeric
 static char *_info_[] = {NULL};	// shoe information might be a phrase
@@ -98,61 +670,200 @@ static double _number_ = 0;	// placeholder for real numbers
 static double _count_ = 0;	// shoe count
 static kind_t _kind_ = A;	// shoe kind
 static bool _new_ = false;	// true/false (no) new shoe
+static const char *_import_ = NULL;	// delimited file to import (headless mode)
+static const char *_find_ = NULL;	// reference code to look up at the end of the session
+static const char *_delete_ = NULL;	// reference code to delete at the start of the session
+static bool _range_ = false;		// reports the items in the cost range at the end of the session
+static double _range_lo_ = 0;
+static double _range_hi_ = 0;
+static size_t _top_ = 0;		// number of items with the highest unit profit to report
+static int _group_ = 0;			// groups the items by kind (1) or by kind and availability (2)
+static const char *_export_ = NULL;	// Arrow IPC file written at the end of the session
+static const char *_snapshot_ = NULL;	// snapshot loaded at startup and saved at the end of the session
+static bool _verify_ = false;		// verifies the checksum of the sections of the snapshot
+static void *_map_ = NULL;		// mapping of the loaded snapshot
+static size_t _map_size_ = 0;
+static const char *_journal_path_ = NULL;	// journal of the items accepted since the snapshot
+static Journal *_journal_ = NULL;
+static long _window_ = JOURNAL_WINDOW_MS;	// group commit window in milliseconds
+static size_t _compact_ = JOURNAL_COMPACT_MB;	// journal size in MiB that triggers a compaction
+static locale_t _locale_ = (locale_t) 0;	// C locale of the numbers that the fast path does not convert
+static bool _bench_ = false;		// runs the benchmarks and exits
+static bool _selftest_ = false;		// checks the aggregation kernels against each other and exits
+static const char *_diff_from_ = NULL;	// snapshots compared by --diff, the old one first
+static const char *_diff_to_ = NULL;
+static size_t _bench_items_ = BENCH_ITEMS;	// items of the synthetic inventory of the benchmarks
+static uint64_t _seed_ = BENCH_SEED;	// seed of the synthetic inventory
+static char _bench_csv_[MAX_BUFFER_SIZE] = "";	// temporary files of the benchmarks, removed by cleanup()
+static char _bench_snap_[MAX_BUFFER_SIZE] = "";
+static bool _quiet_ = false;		// skips the echo of the items that are input
+static bool _stream_ = false;		// folds the items into the totals and the groups without keeping them
+static const char *_stats_ = NULL;	// file of the allocation telemetry, written at exit and on SIGUSR1
+static bool _mem_report_ = false;	// reports the allocation telemetry at exit
+static unsigned _threads_ = 0;		// aggregation threads, zero for one per core
+static Writer *_out_ = NULL;		// buffered writer of the reports
+static Reader *_in_ = NULL;		// block reader of the input that is typed or piped in
+
+// aggregation kernel selected at startup for the host CPU
+typedef void (*aggregate_t)(const double *count,
+			    const double *sale,
+			    const double *cost,
+			    size_t numel,
+			    double *profit,
+			    double *expenses);
+static aggregate_t _aggregate_ = NULL;
+typedef struct {
+	const char *name;
+	aggregate_t kernel;
+} kernel_t;
+static kernel_t _kernels_[4];		// aggregation kernels that the host runs, checked by selftest()
+static size_t _kernels_numel_ = 0;
+// tier kernel selected at startup for the host CPU
+typedef size_t (*tier_t)(const pricing_t *pricing, double cost);
+static tier_t _tier_ = NULL;
+// repricing kernel selected at startup for the host CPU
+typedef size_t (*reprice_t)(const pricing_t *pricing,
+			    const double *factor,
+			    double lo,
+			    double hi,
+			    const double *cost,
+			    double *sale,
+			    Kind *kind,
+			    size_t numel);
+static reprice_t _reprice_ = NULL;
+static bool _repricing_ = false;	// reprices the stored items at the start of the session
+static double _reprice_lo_ = 0;
+static double _reprice_hi_ = HUGE_VAL;
+static const char *_pricing_path_ = NULL;	// pricing tiers that replace the built-in ones
+static pricing_t _pricing_ = {
+	{30.0e3, 60.0e3, HUGE_VAL, HUGE_VAL, HUGE_VAL, HUGE_VAL, HUGE_VAL, HUGE_VAL},
+	{0.50, 0.40, 0.30},
+	3,
+	true
+};
+static const char *_simd_ = "scalar";
 
 void head(void);
 // getters:
 void get(void);
 void gnew(void);
+void gprice(void);
 Item *gitem(void);
+size_t gput(ItemTable *table);
+void erase(ItemTable *table, const char *code);
 // loggers:
 void log(void);
+void flush(void);
 void greet(void);
 // memory handling utilities:
 void init(void);
+void pricing(const char *path);
+void dispatch(void);
 void cleanup(void);
 // console manipulators:
 void clear(void);
-void pause(void);
+void hold(void);
 // post-processing:
-void aggregate(Stack *stack);
-
-int main ()
+void aggregate(ItemTable *table);
+void reprice(ItemTable *table, double lo, double hi);
+void lookup(ItemTable *table, const char *code);
+void range(ItemTable *table, double lo, double hi);
+void top(ItemTable *table, size_t k);
+void group(ItemTable *table, bool avail);
+void report(ItemTable *table);
+// headless mode:
+void args(int argc, char **argv);
+void bench(void);
+void selftest(void);
+void diff(const char *from, const char *to);
+void import(const char *path, ItemTable *table);
+// persistence:
+void load(ItemTable *table, const char *path);
+void save(ItemTable *table, const char *path);
+void replay(ItemTable *table, const char *path);
+void arrow(ItemTable *table, const char *path);
+void compact(ItemTable *table);
+ItemTable *start(void);
+void finish(ItemTable *table);
+
+int main (int argc, char **argv)
 {
-	head();
-	init();
-	Stack *stack = new Stack();
-	if (!stack) {
-		fprintf(stderr, "main: error\n");
+	args(argc, argv);
+	if (_bench_) {
+		init();
+		bench();
 		cleanup();
-		exit(EXIT_FAILURE);
+		return EXIT_SUCCESS;
+	}
+
+	if (_selftest_) {
+		init();
+		selftest();
+		cleanup();
+		return EXIT_SUCCESS;
 	}
 
+	if (_diff_from_) {
+		init();
+		diff(_diff_from_, _diff_to_);
+		cleanup();
+		return EXIT_SUCCESS;
+	}
+
+	if (_import_) {
+		init();
+		ItemTable *table = start();
+		import(_import_, table);
+		finish(table);
+		cleanup();
+		return EXIT_SUCCESS;
+	}
+
+	head();
+	init();
+	ItemTable *table = start();
 	do {
 		get();
-		Item *item = gitem();
-		item->log();
-		item->total();
-		item->profit();
-		stack->add(item);
+		size_t const row = gput(table);
+		if (_journal_) {
+			_journal_->ack(table->_lsn_);
+		}
+
+		if (!_quiet_) {
+			Kind kind(_kind_);
+			Item item = (row != NPOS)? table->row(row) : Item(*_code_,
+									    *_info_,
+									    &_avail_,
+									    &_size_,
+									    &_cost_,
+									    &_sale_,
+									    &_count_,
+									    &kind);
+			item.log();
+			item.total();
+			item.profit();
+			flush();
+		}
 		gnew();
 	} while (_new_);
-	aggregate(stack);
+	finish(table);
 	greet();
 	cleanup();
-	pause();
+	hold();
 	return EXIT_SUCCESS;
 }
 
-static m_chain_t *Util_Chain (m_chain_t *node)
+static m_chain_t *Util_Chain (m_heap_t *heap, m_chain_t *node)
 {
-	m_chain_t *next = (_m_chain_.next)? _m_chain_.next : NULL;
+	m_chain_t *next = (heap->chain.next)? heap->chain.next : NULL;
 	if (next) {
 		next->prev = node;
 	}
 
 	node->next = next;
-	node->prev = &_m_chain_ ;
-	_m_chain_.next = node;
+	node->prev = &heap->chain;
+	node->heap = heap;
+	heap->chain.next = node;
 	return node;
 }
 
@@ -198,15 +909,21 @@ static void skipWhiteSpace (char **txt)
 	}
 }
 
-static void nullTrailWhiteSpace (char **text)
+// trims the whitespace around the line of chars in place, the line is not copied
+static size_t trimWhiteSpace (char **text, size_t const chars)
 {
-	size_t const len = strlen(*text);
-	char *txt = *text;
-	char *iter = &txt[len - 1];
-	while (*iter <= ' ') {
-		*iter = 0;
-		--iter;
+	char *begin = *text;
+	char *end = begin + chars;
+	while (begin != end && *begin <= ' ') {
+		++begin;
+	}
+
+	while (end != begin && end[-1] <= ' ') {
+		--end;
 	}
+
+	*text = begin;
+	return (end - begin);
 }
 
 static bool is_numeric (char **text)
@@ -272,6 +989,126 @@ static bool toNumber (char **text)
 	return invalid;
 }
 
+/*
+
+validates and converts the number in a single scan, it rejects what is_numeric() and toNumber()
+reject: anything but a decimal number (with an optional sign, fraction and exponent) followed
+by whitespace, and values out of the range of doubles. Numbers with up to 19 significant digits
+and powers of ten up to 22 are exact products (or quotients) of doubles [5], the rest of the
+numbers are handed to strtod_l() in the C locale so that they are correctly rounded as well.
+The old two-pass path is kept as the baseline of the microbenchmark (see bench()).
+
+*/
+
+static bool parseNumber (const char *text, double *number)
+{
+	static double const pow10[] = {
+		1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+		1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+		1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	const char *iter = text;
+	while (*iter != '\n' && isspace((unsigned char) *iter)) {
+		++iter;
+	}
+
+	const char *begin = iter;
+	bool const negative = (*iter == '-');
+	if (*iter == '-' || *iter == '+') {
+		++iter;
+	}
+
+	uint64_t mantissa = 0;
+	int digits = 0;			// significant digits in the mantissa
+	int scale = 0;			// power of ten of the digits that the mantissa drops
+	bool truncated = false;
+	bool any = false;
+	while (*iter >= '0' && *iter <= '9') {
+		any = true;
+		if (digits < PARSE_MAX_DIGITS) {
+			mantissa = 10 * mantissa + (*iter - '0');
+			digits += (mantissa != 0);
+		} else {
+			truncated |= (*iter != '0');
+			++scale;
+		}
+		++iter;
+	}
+
+	if (*iter == '.') {
+		++iter;
+		while (*iter >= '0' && *iter <= '9') {
+			any = true;
+			if (digits < PARSE_MAX_DIGITS) {
+				mantissa = 10 * mantissa + (*iter - '0');
+				digits += (mantissa != 0);
+				--scale;
+			} else {
+				truncated |= (*iter != '0');
+			}
+			++iter;
+		}
+	}
+
+	if (!any) {
+		return true;
+	}
+
+	if (*iter == 'e' || *iter == 'E') {
+		const char *exp = iter + 1;
+		bool const minus = (*exp == '-');
+		if (*exp == '-' || *exp == '+') {
+			++exp;
+		}
+
+		if (*exp >= '0' && *exp <= '9') {
+			int power = 0;
+			while (*exp >= '0' && *exp <= '9') {
+				if (power < 100000) {
+					power = 10 * power + (*exp - '0');
+				}
+				++exp;
+			}
+			scale += (minus)? -power : power;
+			iter = exp;
+		}
+	}
+
+	// the number ends at whitespace and nothing but whitespace may follow it on the line
+	if (!isspace((unsigned char) *iter)) {
+		return true;
+	}
+
+	for (const char *tail = iter; *tail && *tail != '\n'; ++tail) {
+		if (*tail > ' ') {
+			return true;
+		}
+	}
+
+	double value = 0;
+	if (!mantissa) {
+		value = 0;
+	} else if (!truncated &&
+		   mantissa <= (((uint64_t) 1) << 53) &&
+		   scale >= -PARSE_MAX_EXACT &&
+		   scale <= PARSE_MAX_EXACT) {
+		value = (double) mantissa;
+		value = (scale < 0)? value / pow10[-scale] : value * pow10[scale];
+	} else {
+		errno = 0;
+		value = strtod_l(begin, NULL, _locale_);
+		if (errno == ERANGE) {
+			return true;
+		}
+		*number = value;
+		return false;
+	}
+
+	*number = (negative)? -value : value;
+	return false;
+}
+
 static void default_callback (bool *invalid)
 {
 	if (*invalid) {
@@ -315,20 +1152,19 @@ static void validData (const char *fname,
 		       const char *msg = "Please input valid data")
 {
 	_number_ = 0;
-	memset(*_temp_, 0, _sz_);
 	printf("%s", prompt);
 	ssize_t chars = 0;
+	char *text = NULL;
 	bool invalid = true;
 	do {
 		errno = 0;
-		chars = getline(_temp_, &_sz_, stdin);
+		chars = _in_->line(&text);
 		if (chars == -1) {	// caters EOF
 			if (errno) {
 				fprintf(stderr, "%s: %s\n", fname, strerror(errno));
 				cleanup();
 				exit(EXIT_FAILURE);
 			}
-			clearerr(stdin);
 			printf("\n%s\n", msg);
 			printf("%s", prompt);
 		} else if (chars > MAX_STRING_LEN) {
@@ -336,23 +1172,12 @@ static void validData (const char *fname,
 			invalid = true;
 			char msg[] = "The input exceeds the max number of chars %d\n";
 			printf(msg, MAX_STRING_LEN);
-			*_temp_ = (char*) realloc(*_temp_, MAX_BUFFER_SIZE);
-			if (!*_temp_) {
-				fprintf(stderr, "validData: %s\n", strerror(errno));
-				cleanup();
-				exit(EXIT_FAILURE);
-			}
-			memset(*_temp_, 0, MAX_BUFFER_SIZE);
-			_sz_ = MAX_BUFFER_SIZE;
 			printf("%s", prompt);
 
 		} else {
 
-			if (!is_numeric(_temp_)) {
-				invalid = true;
-			} else {
-				invalid = toNumber(_temp_);
-			}
+			// the view ends at its newline, which is all that parseNumber() needs
+			invalid = parseNumber(text, &_number_);
 
 			if (_number_ < 0) {
 				invalid = true;
@@ -369,982 +1194,6607 @@ static void validData (const char *fname,
 	} while (chars == -1 || invalid);
 }
 
-void *Util_Free (void *p)
+static void Util_RegionFree (m_region_t *chunk)
 {
-	if (!p) {
+	munmap((void*) chunk, chunk->size);
+}
+
+// maps a chunk aligned to its size so that it can be backed by a huge page
+static m_region_t *Util_RegionChunk (m_heap_t *heap)
+{
+	size_t const size = REGION_CHUNK_SIZE;
+	size_t const span = 2 * size;
+	void *p = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		fprintf(stderr, "Util_RegionChunk: %s\n", strerror(errno));
 		return NULL;
 	}
 
-	m_chain_t *node = ((m_chain_t*) p) - 1;
-	if (node->hash != HASH) {
-		fprintf(stderr, "Util_Free: unregistered object error\n");
-		return p;
+	char *addr = (char*) p;
+	char *start = (char*) ((((size_t) addr) + (size - 1)) & ~(size - 1));
+	size_t const head = (start - addr);
+	size_t const tail = (span - head - size);
+	if (head) {
+		munmap(addr, head);
 	}
 
-	size_t const size = node->size;
-	node = Util_Remove(node);
+	if (tail) {
+		munmap(start + size, tail);
+	}
+
+#if defined(HUGEPAGES) && HUGEPAGES && defined(MADV_HUGEPAGE)
+	if (madvise(start, size, MADV_HUGEPAGE) == -1) {
+		fprintf(stderr, "Util_RegionChunk: %s\n", strerror(errno));
+	}
+#endif
 
-	_m_size_ -= size;
-	--_m_count_ ;
+	m_region_t *chunk = (m_region_t*) start;
+	chunk->next = heap->region;
+	chunk->heap = heap;
+	chunk->size = size;
+	heap->region = chunk;
 
-	return NULL;
+	size_t const align = REGION_ALIGN;
+	heap->avail = start + ((sizeof(m_region_t) + (align - 1)) & ~(align - 1));
+	heap->limit = start + size;
+	return chunk;
 }
 
-void Util_Clear (void)
+// bumps the pointer of the region, the memory is reclaimed all at once by Util_Clear()
+static void *Util_RegionBump (m_heap_t *heap, size_t const size)
 {
-	m_chain_t *next = NULL;
-	for (m_chain_t *node = _m_chain_.next; node; node = next) {
-		next = node->next;
-		void *data = node->data;
-		node = (m_chain_t*) Util_Free(data);
+	if (!heap->avail || (size_t) (heap->limit - heap->avail) < size) {
+		if (!Util_RegionChunk(heap)) {
+			return NULL;
+		}
 	}
 
-	_m_size_ = 0;
-	_m_count_ = 0;
+	void *p = heap->avail;
+	heap->avail += size;
+	return p;
 }
 
-void *Util_Malloc (size_t const sz)
+static size_t Util_SizeClass (size_t const size)
 {
-	size_t const size = sizeof(m_chain_t) + sz;
-	void *p = malloc(size);
-	if (!p) {
-		fprintf(stderr, "Util_Malloc: %s\n", strerror(errno));
-		return NULL;
+	if (size <= 16) {
+		return 0;
 	}
 
-	m_chain_t* node = (m_chain_t*) p;
-	void *data = (node + 1);
-
-	node = Util_Chain(node);
-	node->data = data;
-	node->hash = HASH;
-	node->size = size;
-
-	_m_size_ += size;
-	++_m_count_ ;
-
-	return data;
+	size_t const cls = (64 - __builtin_clzl(size - 1)) - 4;
+	return (cls < M_CLASSES)? cls : (M_CLASSES - 1);
 }
 
-char *Util_CopyString (char *string)
+static void Util_Count (m_heap_t *heap, size_t const size, size_t const header, unsigned const tag)
 {
-	size_t const len = strlen(string);
-	size_t const sz = (len + 1);
-	void *ptr = Util_Malloc(sz);
-	if (!ptr) {
-		fprintf(stderr, "Util_CopyString: error\n");
-		return NULL;
+	m_stats_t *stats = &heap->stats;
+	heap->size += size;
+	++heap->count;
+	++stats->allocations;
+	stats->headers += header;
+	++stats->objects[tag];
+	stats->bytes[tag] += size;
+	++stats->classes[Util_SizeClass(size)];
+	if (heap->size > stats->peak) {
+		stats->peak = heap->size;
 	}
-
-	char *src = string;
-	char *dst = (char*) ptr;
-	return strcpy(dst, src);
 }
 
-double *Util_CopyNumber (double *num)
+static void Util_Uncount (m_heap_t *heap, size_t const size, size_t const header, unsigned const tag)
 {
-	double *ptr = (double*) Util_Malloc(sizeof(*num));
-	if (!ptr) {
-		fprintf(stderr, "Util_CopyNumber: error\n");
-		return NULL;
-	}
-
-	*ptr = *num;
-	return ptr;
+	m_stats_t *stats = &heap->stats;
+	heap->size -= size;
+	--heap->count;
+	stats->headers -= header;
+	--stats->objects[tag];
+	stats->bytes[tag] -= size;
+	--stats->classes[Util_SizeClass(size)];
 }
 
-Kind::Kind (kind_t const kind) : kind(kind)
+// sums the counters of the heaps, the sum of their peaks bounds the peak of the process
+static void Util_Totals (m_stats_t *total, size_t *size, size_t *count)
 {
-	return;
+	memset(total, 0, sizeof(*total));
+	*size = 0;
+	*count = 0;
+	for (m_heap_t *heap = _m_heaps_.load(std::memory_order_acquire); heap; heap = heap->next) {
+		const m_stats_t *stats = &heap->stats;
+		*size += heap->size;
+		*count += heap->count;
+		total->peak += stats->peak;
+		total->allocations += stats->allocations;
+		total->headers += stats->headers;
+		for (size_t t = 0; t != M_TAGS; ++t) {
+			total->objects[t] += stats->objects[t];
+			total->bytes[t] += stats->bytes[t];
+		}
+
+		for (size_t c = 0; c != M_CLASSES; ++c) {
+			total->classes[c] += stats->classes[c];
+		}
+	}
 }
 
-kind_t Kind::k () const
+static void Util_Register (m_heap_t *heap)
 {
-	return this->kind;
+	m_heap_t *next = _m_heaps_.load(std::memory_order_relaxed);
+	do {
+		heap->next = next;
+	} while (!_m_heaps_.compare_exchange_weak(next, heap, std::memory_order_release, std::memory_order_relaxed));
 }
 
-const char *Kind::stringify (const Kind *kind)
+static void Util_Detach (void *p);
+
+static void Util_Key (void)
 {
-	kind_t const k = kind->k();
-	switch(k) {
-		case A:
-			return "A";
-		case B:
-			return "B";
-		default:
-			return "C";
+	if (pthread_key_create(&_m_key_, Util_Detach) != 0) {
+		fprintf(stderr, "Util_Key: error\n");
 	}
 }
 
-kind_t Kind::enumerator (const char *kind)
+// binds a heap to the calling thread, the first thread takes the static one
+static m_heap_t *Util_Attach (void)
 {
-	if (!strcmp(kind, "A")) {
-		return A;
+	static std::atomic<bool> claimed(false);
+	m_heap_t *heap = NULL;
+	if (!claimed.exchange(true)) {
+		heap = &_m_main_;
+		Util_Register(&_m_orphan_);
+		Util_Register(heap);
+		_m_local_ = heap;
+		return heap;
+	}
+
+	pthread_once(&_m_once_, Util_Key);
+	{
+		std::lock_guard<std::mutex> lock(_m_lock_);
+		heap = _m_idle_;
+		if (heap) {
+			_m_idle_ = heap->link;
+			heap->link = NULL;
+		}
 	}
 
-	if (!strcmp(kind, "B")) {
-		return B;
+	if (!heap) {
+		heap = (m_heap_t*) calloc(1, sizeof(m_heap_t));
+		if (!heap) {
+			fprintf(stderr, "Util_Attach: %s\n", strerror(errno));
+			return NULL;
+		}
+
+		Util_Register(heap);
 	}
 
-	if (!strcmp(kind, "C")) {
-		return C;
+	if (pthread_setspecific(_m_key_, heap) != 0) {
+		fprintf(stderr, "Util_Attach: error\n");
 	}
 
-	kind_t unknown = ((kind_t) 0xffffffff);
-	return unknown;
+	_m_local_ = heap;
+	return heap;
 }
 
-void *Kind::operator new (size_t size)
+static inline m_heap_t *Util_Heap (void)
 {
-	return Util_Malloc(size);
+	m_heap_t *heap = _m_local_;
+	return (heap)? heap : Util_Attach();
 }
 
-void Kind::operator delete (void *p)
+static m_heap_t *Util_Owner (m_head_t *head)
 {
-	p = Util_Free(p);
+	if (head->hash == HASH) {
+		m_chain_t *node = ((m_chain_t*) (head + 1)) - 1;
+		return __atomic_load_n(&node->heap, __ATOMIC_ACQUIRE);
+	}
+
+	size_t const mask = ~((size_t) REGION_CHUNK_SIZE - 1);
+	m_region_t *chunk = (m_region_t*) (((size_t) head) & mask);
+	return __atomic_load_n(&chunk->heap, __ATOMIC_ACQUIRE);
 }
 
-Item::Item (char *code,
-            char *info,
-            char *avail,
-            double *size,
-            double *cost,
-            double *sale,
-            double *count,
-            Kind *kind)
+static size_t Util_PoolClass (size_t const sz)
 {
-	this->code = code;
-	this->info = info;
-	this->avail = avail;
-	this->size = size;
-	this->cost = cost;
-	this->sale = sale;
-	this->count = count;
-	this->kind = kind;
+	size_t cls = 0;
+	size_t size = POOL_MIN_OBJECT;
+	while (size < sz) {
+		size *= 2;
+		++cls;
+	}
+
+	return cls;
 }
 
-void Item::log () const
+// carves a slab out of the region into free slots of the size class
+static m_slot_t *Util_PoolCarve (m_heap_t *heap, size_t const cls)
 {
-	printf("REFERENCE: %s\n", this->code);
-	printf("DESCRIPTION: %s\n", this->info);
-	printf("SIZE: %.1f\n", *this->size);
-	printf("AVAILABLE: %s\n", this->avail);
-	printf("COST: %.2f\n", *this->cost);
-	printf("SALE: %.2f\n", *this->sale);
-	printf("COUNT: %.0f\n", *this->count);
-	printf("KIND: %s\n", this->kind->stringify(this->kind));
+	size_t const size = sizeof(m_head_t) + (POOL_MIN_OBJECT << cls);
+	size_t const numel = POOL_SLAB_SIZE / size;
+	char *slab = (char*) Util_RegionBump(heap, numel * size);
+	if (!slab) {
+		return NULL;
+	}
+
+	m_slot_t *next = NULL;
+	for (size_t i = numel; i != 0; --i) {
+		m_slot_t *slot = (m_slot_t*) (slab + (i - 1) * size);
+		slot->head.hash = POOL_FREE_HASH;
+		slot->head.size = size;
+		slot->next = next;
+		next = slot;
+	}
+
+	heap->pool[cls] = next;
+	return next;
 }
 
-void Item::total () const
+static void Util_PoolFree (m_heap_t *heap, m_head_t *head)
 {
-	double const cost = *this->cost;
-	double const sale = *this->sale;
-	double const units = *this->count;
-	double const total_cost = units * cost;
-	double const total_sale = units * sale;
-	printf("TOTAL COST: %.2f\n", total_cost);
-	printf("TOTAL PROFIT OF %.0f UNITS: %.2f\n", units, total_sale);
+	size_t const size = (head->size & M_SIZE_MASK);
+	unsigned const tag = (head->size >> M_TAG_SHIFT);
+	size_t const cls = Util_PoolClass(size - sizeof(m_head_t));
+	m_slot_t *slot = (m_slot_t*) head;
+	slot->head.hash = POOL_FREE_HASH;
+	slot->head.size = size;
+	slot->next = heap->pool[cls];
+	heap->pool[cls] = slot;
+	Util_Uncount(heap, size, sizeof(m_head_t), tag);
 }
 
-void Item::profit () const
+// frees an object of the heap, the caller owns the heap
+static void Util_Release (m_heap_t *heap, m_head_t *head)
 {
-	double const cost = *this->cost;
-	double const sale = *this->sale;
-	double const units = *this->count;
-	double const profit = (sale - cost);
-	double const total_cost = units * cost;
-	double const net_profit = units * (sale - cost);
-	printf("PROFIT PER UNIT: %.2f\n", profit);
-	printf("NET PROFIT: %.2f\n", net_profit);
-	printf("PROFIT PERCENTAGE: %.2f\n", (net_profit / total_cost) * 100);
-}
+	if (head->hash == POOL_HASH) {
+		Util_PoolFree(heap, head);
+		return;
+	}
 
-void *Item::operator new (size_t size)
-{
-	return Util_Malloc(size);
+	m_chain_t *node = ((m_chain_t*) (head + 1)) - 1;
+	size_t const size = (node->size & M_SIZE_MASK);
+	unsigned const tag = (node->size >> M_TAG_SHIFT);
+	node = Util_Remove(node);
+	Util_Uncount(heap, size, sizeof(m_chain_t), tag);
 }
 
-void Item::operator delete (void *p)
+// hands the object over to the thread that owns it, lock-free
+static void Util_Remote (m_heap_t *heap, void *p)
 {
-	p = Util_Free(p);
+	void **link = (void**) p;
+	void *next = heap->remote.load(std::memory_order_relaxed);
+	do {
+		*link = next;
+	} while (!heap->remote.compare_exchange_weak(next, p, std::memory_order_release, std::memory_order_relaxed));
 }
 
-static void stk_err_create ()
+// frees the objects that other threads handed over, forwards those the heap no longer owns
+static void Util_Drain (m_heap_t *heap)
 {
-	fprintf(stderr, "Stack::create: error\n");
+	void *p = heap->remote.exchange(NULL, std::memory_order_acquire);
+	while (p) {
+		void *next = *((void**) p);
+		m_head_t *head = ((m_head_t*) p) - 1;
+		if (head->hash != HASH && head->hash != POOL_HASH) {
+			fprintf(stderr, "Util_Drain: unregistered object error\n");
+		} else {
+			m_heap_t *owner = Util_Owner(head);
+			if (owner == heap) {
+				Util_Release(heap, head);
+			} else {
+				Util_Remote(owner, p);
+			}
+		}
+		p = next;
+	}
 }
 
-static void stk_err_init ()
+static inline void Util_Collect (m_heap_t *heap)
 {
-	fprintf(stderr, "Stack::init: error\n");
+	if (heap->remote.load(std::memory_order_relaxed)) {
+		Util_Drain(heap);
+	}
 }
 
-static void stk_err_add ()
+// moves the objects and the counters of a heap into another one, rewriting their owner
+static void Util_Merge (m_heap_t *heap, m_heap_t *from)
 {
-	fprintf(stderr, "Stack::add: error\n");
-}
+	m_chain_t *last = NULL;
+	for (m_chain_t *node = from->chain.next; node; node = node->next) {
+		__atomic_store_n(&node->heap, heap, __ATOMIC_RELEASE);
+		last = node;
+	}
 
-static void stk_err_copy ()
-{
-	fprintf(stderr, "Stack::copy: error\n");
+	if (last) {
+		m_chain_t *first = from->chain.next;
+		last->next = heap->chain.next;
+		if (heap->chain.next) {
+			heap->chain.next->prev = last;
+		}
+		heap->chain.next = first;
+		first->prev = &heap->chain;
+		from->chain.next = NULL;
+	}
+
+	m_region_t *tail = NULL;
+	for (m_region_t *chunk = from->region; chunk; chunk = chunk->next) {
+		__atomic_store_n(&chunk->heap, heap, __ATOMIC_RELEASE);
+		tail = chunk;
+	}
+
+	// appends the chunks so that the most recent chunk of the heap stays first
+	if (tail) {
+		if (heap->region) {
+			tail->next = heap->region->next;
+			heap->region->next = from->region;
+		} else {
+			heap->region = from->region;
+		}
+		from->region = NULL;
+	}
+
+	from->avail = NULL;
+	from->limit = NULL;
+	for (size_t cls = 0; cls != POOL_CLASSES; ++cls) {
+		m_slot_t *slot = from->pool[cls];
+		if (!slot) {
+			continue;
+		}
+
+		while (slot->next) {
+			slot = slot->next;
+		}
+
+		slot->next = heap->pool[cls];
+		heap->pool[cls] = from->pool[cls];
+		from->pool[cls] = NULL;
+	}
+
+	m_stats_t *stats = &heap->stats;
+	m_stats_t *other = &from->stats;
+	heap->size += from->size;
+	heap->count += from->count;
+	stats->peak += other->peak;
+	stats->allocations += other->allocations;
+	stats->headers += other->headers;
+	for (size_t t = 0; t != M_TAGS; ++t) {
+		stats->objects[t] += other->objects[t];
+		stats->bytes[t] += other->bytes[t];
+	}
+
+	for (size_t c = 0; c != M_CLASSES; ++c) {
+		stats->classes[c] += other->classes[c];
+	}
+
+	from->size = 0;
+	from->count = 0;
+	memset(other, 0, sizeof(*other));
+
+	// the pending objects now belong to the heap, the drain forwards them there
+	Util_Drain(from);
 }
 
-static void stk_err_grow ()
+// merges the heap of an exiting thread into the orphan heap, its objects stay valid
+static void Util_Detach (void *p)
 {
-	fprintf(stderr, "Stack::grow: error\n");
+	m_heap_t *heap = (m_heap_t*) p;
+	std::lock_guard<std::mutex> lock(_m_lock_);
+	Util_Merge(&_m_orphan_, heap);
+	Util_Drain(&_m_orphan_);
+	heap->link = _m_idle_;
+	_m_idle_ = heap;
+	_m_local_ = NULL;
 }
 
-static void **stk_create (size_t const allot)
+void *Util_Free (void *p)
 {
-	size_t const limit = (allot + 1);
-	size_t const size = limit * sizeof(void*);
-	void *p = Util_Malloc(size);
 	if (!p) {
-		stk_err_create();
 		return NULL;
 	}
 
-	memset(p, 0, size);
-	return ((void**) p);
-}
+	m_head_t *head = ((m_head_t*) p) - 1;
+	if (head->hash != HASH && head->hash != POOL_HASH) {
+		fprintf(stderr, "Util_Free: unregistered object error\n");
+		return p;
+	}
 
-Stack::Stack (void)
-{
-	return;
-}
+	m_heap_t *heap = Util_Heap();
+	m_heap_t *owner = Util_Owner(head);
+	if (owner == heap) {
+		Util_Release(heap, head);
+	} else if (owner == &_m_orphan_) {
+		std::lock_guard<std::mutex> lock(_m_lock_);
+		Util_Release(owner, head);
+		Util_Drain(owner);
+	} else {
+		Util_Remote(owner, p);
+	}
 
-size_t Stack::cap () const
-{
-	return (this->_limit_ - this->_begin_);
+	return NULL;
 }
 
-size_t Stack::numel () const
+static void Util_Reset (m_heap_t *heap)
 {
-	return (this->_avail_ - this->_begin_);
-}
+	m_chain_t *next = NULL;
+	for (m_chain_t *node = heap->chain.next; node; node = next) {
+		next = node->next;
+		node = Util_Remove(node);
+	}
 
-size_t Stack::bytes () const
-{
-	return this->_size_;
-}
+	m_region_t *chunk = heap->region;
+	while (chunk) {
+		m_region_t *next = chunk->next;
+		Util_RegionFree(chunk);
+		chunk = next;
+	}
 
-void **Stack::begin ()
-{
-	return this->_begin_;
+	for (size_t cls = 0; cls != POOL_CLASSES; ++cls) {
+		heap->pool[cls] = NULL;
+	}
+
+	heap->remote.store(NULL, std::memory_order_relaxed);
+	heap->region = NULL;
+	heap->avail = NULL;
+	heap->limit = NULL;
+	heap->size = 0;
+	heap->count = 0;
+	// keeps the peak and the number of allocations, the marks of the whole run
+	heap->stats.headers = 0;
+	memset(heap->stats.objects, 0, sizeof(heap->stats.objects));
+	memset(heap->stats.bytes, 0, sizeof(heap->stats.bytes));
+	memset(heap->stats.classes, 0, sizeof(heap->stats.classes));
 }
 
-void **Stack::end ()
+// releases the memory of every heap, the other threads must have exited
+void Util_Clear (void)
 {
-	return this->_avail_;
+	std::lock_guard<std::mutex> lock(_m_lock_);
+	for (m_heap_t *heap = _m_heaps_.load(std::memory_order_acquire); heap; heap = heap->next) {
+		Util_Reset(heap);
+	}
 }
 
-void *Stack::copy () const
+// pops a slot off the free list of the size class that fits the object
+static void *Util_PoolSlot (m_heap_t *heap, size_t const sz, unsigned const tag)
 {
-	size_t const numel = this->numel();
-	size_t const size = numel * sizeof(void*);
-	void *dst = Util_Malloc(size);
-	if (!dst) {
-		stk_err_copy();
-		return NULL;
+	size_t const cls = Util_PoolClass(sz);
+	m_slot_t *slot = heap->pool[cls];
+	if (!slot) {
+		slot = Util_PoolCarve(heap, cls);
+		if (!slot) {
+			return NULL;
+		}
 	}
 
-	const void *src = ((const void*) this->_stack_);
-	memcpy(dst, src, size);
-	return dst;
+	heap->pool[cls] = slot->next;
+	size_t const size = slot->head.size;
+	slot->head.hash = POOL_HASH;
+	slot->head.size = size | (((size_t) tag) << M_TAG_SHIFT);
+	Util_Count(heap, size, sizeof(m_head_t), tag);
+	return (&slot->head + 1);
 }
 
-int Stack::grow ()
+// small objects come from the pools, larger ones are chained, both are reused once freed
+void *Util_Malloc (size_t const sz, unsigned const tag = M_OTHER)
 {
-	int rc = 0;
-	void **stack = NULL;
-	size_t const numel = this->numel();
-	size_t const size = numel * sizeof(void*);
-	size_t const allot = 2 * numel;
-	void *data = this->copy();
-	if (!data) {
-		goto err;
+	m_heap_t *heap = Util_Heap();
+	if (!heap) {
+		fprintf(stderr, "Util_Malloc: error\n");
+		return NULL;
 	}
 
-	stack = stk_create(allot);
-	if (!stack) {
-		goto err;
+	Util_Collect(heap);
+	if (sz <= POOL_MAX_OBJECT) {
+		void *data = Util_PoolSlot(heap, sz, tag);
+		if (!data) {
+			fprintf(stderr, "Util_Malloc: error\n");
+		}
+		return data;
 	}
 
-	memcpy(stack, data, size);
-	data = Util_Free(data);
+	size_t const size = sizeof(m_chain_t) + sz;
+	void *p = malloc(size);
+	if (!p) {
+		fprintf(stderr, "Util_Malloc: %s\n", strerror(errno));
+		return NULL;
+	}
 
-	this->_stack_ = stack;
-	this->_begin_ = stack;
-	this->_avail_ = stack + numel;
-	this->_limit_ = stack + allot;
-	this->_allot_ = allot;
-	return rc;
+	m_chain_t* node = (m_chain_t*) p;
+	void *data = (node + 1);
 
-err:
-	rc = -1;
-	stk_err_grow();
-	return rc;
+	node = Util_Chain(heap, node);
+	node->data = data;
+	node->hash = HASH;
+	node->size = size | (((size_t) tag) << M_TAG_SHIFT);
+	Util_Count(heap, size, sizeof(m_chain_t), tag);
+	return data;
 }
 
-int Stack::init ()
+// payload capacity of an object obtained from Util_Malloc() or Util_PoolMalloc()
+static size_t Util_Capacity (void *p)
 {
-	int rc = 0;
-	this->_stack_ = stk_create(this->_allot_);
-	if (!this->_stack_) {
-		rc = -1;
-		stk_err_init();
-		return rc;
+	m_head_t *head = ((m_head_t*) p) - 1;
+	size_t const size = (head->size & M_SIZE_MASK);
+	if (head->hash == HASH) {
+		return (size - sizeof(m_chain_t));
 	}
 
-	this->_begin_ = this->_stack_;
-	this->_avail_ = this->_stack_;
-	this->_limit_ = this->_stack_ + this->_allot_;
-	return rc;
+	return (size - sizeof(m_head_t));
 }
 
-int Stack::add (void *elem)
+// resizes chained objects in place with realloc(), which resorts to mremap() for large sizes
+// the object keeps its tag, the tag applies to new objects only
+void *Util_Realloc (void *p, size_t const sz, unsigned const tag = M_OTHER)
 {
-	int rc = 0;
-	if (!this->_stack_) {
-		rc = this->init();
-		if (rc != 0) {
-			goto err;
-		}
+	if (!p) {
+		return Util_Malloc(sz, tag);
 	}
 
-	if (this->_avail_ == this->_limit_) {
-		rc = this->grow();
-		if (rc != 0) {
-			goto err;
+	m_head_t *head = ((m_head_t*) p) - 1;
+	if (head->hash != HASH && head->hash != POOL_HASH) {
+		fprintf(stderr, "Util_Realloc: unregistered object error\n");
+		return NULL;
+	}
+
+	// objects of other threads are copied since only the owner may relink them
+	m_heap_t *heap = Util_Heap();
+	if (head->hash != HASH || Util_Owner(head) != heap) {
+		void *data = Util_Malloc(sz, head->size >> M_TAG_SHIFT);
+		if (!data) {
+			fprintf(stderr, "Util_Realloc: error\n");
+			return NULL;
 		}
+
+		size_t const cap = Util_Capacity(p);
+		memcpy(data, p, (cap < sz)? cap : sz);
+		p = Util_Free(p);
+		return data;
 	}
 
-	*this->_avail_ = elem;
-	++this->_avail_;
-	this->_size_ += sizeof(void*);
-	return rc;
+	m_chain_t *node = ((m_chain_t*) p) - 1;
+	size_t const prev_size = (node->size & M_SIZE_MASK);
+	unsigned const prev_tag = (node->size >> M_TAG_SHIFT);
+	size_t const size = sizeof(m_chain_t) + sz;
+	m_chain_t *next = (m_chain_t*) realloc(node, size);
+	if (!next) {
+		fprintf(stderr, "Util_Realloc: %s\n", strerror(errno));
+		return NULL;
+	}
 
-err:
-	stk_err_add();
-	return rc;
+	// relinks the node since realloc() may have moved it
+	node = next;
+	node->prev->next = node;
+	if (node->next) {
+		node->next->prev = node;
+	}
+	node->data = (node + 1);
+	node->size = size | (((size_t) prev_tag) << M_TAG_SHIFT);
+	Util_Uncount(heap, prev_size, sizeof(m_chain_t), prev_tag);
+	Util_Count(heap, size, sizeof(m_chain_t), prev_tag);
+	return node->data;
 }
 
-void *Stack::operator new (size_t size)
+// objects that are allocated and freed in bulk, such as items and kinds
+void *Util_PoolMalloc (size_t const sz, unsigned const tag = M_OTHER)
 {
-	return Util_Malloc(size);
-}
+	if (sz > POOL_MAX_OBJECT) {
+		return Util_Malloc(sz, tag);
+	}
 
-void Stack::operator delete (void *p)
-{
-	p = Util_Free(p);
+	m_heap_t *heap = Util_Heap();
+	if (!heap) {
+		fprintf(stderr, "Util_PoolMalloc: error\n");
+		return NULL;
+	}
+
+	Util_Collect(heap);
+	void *data = Util_PoolSlot(heap, sz, tag);
+	if (!data) {
+		fprintf(stderr, "Util_PoolMalloc: error\n");
+	}
+	return data;
 }
 
-void init (void)
+char *Util_CopyString (char *string)
 {
-	size_t const sz = MAX_BUFFER_SIZE;
-	*_temp_ = (char*) Util_Malloc(sz);
-	if (!*_temp_) {
-		fprintf(stderr, "init: %s\n", strerror(errno));
-		cleanup();
-		exit(EXIT_FAILURE);
+	size_t const len = strlen(string);
+	size_t const sz = (len + 1);
+	void *ptr = Util_Malloc(sz, M_STRING);
+	if (!ptr) {
+		fprintf(stderr, "Util_CopyString: error\n");
+		return NULL;
 	}
 
-	*_code_ = (char*) Util_Malloc(sz);
-	if (!*_code_) {
-		fprintf(stderr, "init: %s\n", strerror(errno));
-		cleanup();
-		exit(EXIT_FAILURE);
-	}
+	char *src = string;
+	char *dst = (char*) ptr;
+	return strcpy(dst, src);
+}
 
-	*_info_ = (char*) Util_Malloc(sz);
-	if (!*_info_) {
-		fprintf(stderr, "init: %s\n", strerror(errno));
-		cleanup();
-		exit(EXIT_FAILURE);
+double *Util_CopyNumber (double *num)
+{
+	double *ptr = (double*) Util_PoolMalloc(sizeof(*num), M_NUMBER);
+	if (!ptr) {
+		fprintf(stderr, "Util_CopyNumber: error\n");
+		return NULL;
 	}
 
-	_sz_ = sz;
+	*ptr = *num;
+	return ptr;
 }
 
-void head (void)
+// appends to the report without stdio so that the report can be rendered in a signal handler
+static char *Util_Put (char *dst, const char *limit, const char *str, bool const upper = false)
 {
-	printf("SHOE SALES INVENTORY PROGRAM\n");
+	while (*str && dst != limit) {
+		char const c = *str;
+		*dst = (upper && c >= 'a' && c <= 'z')? (c - 'a' + 'A') : c;
+		++dst;
+		++str;
+	}
+
+	return dst;
 }
 
-void gcode (void)
+static char *Util_PutNumber (char *dst, const char *limit, size_t n)
 {
-	size_t n = MAX_BUFFER_SIZE;
-	bool invalid = true;
-	ssize_t chars = 0;
-	char *text = NULL;
-	const char prompt[] = "Input the shoe reference code:";
-	printf("%s", prompt);
-	memset(*_code_, 0, MAX_BUFFER_SIZE);
+	char digits[24];
+	char *end = digits + sizeof(digits);
+	char *iter = end;
 	do {
-		errno = 0;
-		chars = getline(_code_, &n, stdin);
-		if (chars == -1) {
+		*--iter = (char) ('0' + (n % 10));
+		n /= 10;
+	} while (n);
 
-			if (errno) {
-				fprintf(stderr, "gcode: %s\n", strerror(errno));
-				cleanup();
-				exit(EXIT_FAILURE);
-			}
+	while (iter != end && dst != limit) {
+		*dst = *iter;
+		++dst;
+		++iter;
+	}
 
-			clearerr(stdin);
-			printf("\nPlease input valid data\n");
-			printf("%s", prompt);
+	return dst;
+}
 
-		} else if (chars > MAX_STRING_LEN) {
-			invalid = true;
-			char msg[] = "The input exceeds the max number of chars %d\n";
-			printf(msg, MAX_STRING_LEN);
-			*_code_ = (char*) realloc(*_code_, MAX_BUFFER_SIZE);
-			if (!*_code_) {
-				fprintf(stderr, "gcode: %s\n", strerror(errno));
-				cleanup();
-				exit(EXIT_FAILURE);
-			}
-			memset(*_code_, 0, MAX_BUFFER_SIZE);
-			n = MAX_BUFFER_SIZE;
-			printf("%s", prompt);
-		} else {
-			text = *_code_ ;
-			skipWhiteSpace(&text);
-			if (!*text || *text == '\n') {
-				invalid = true;
-				printf("Please input a valid reference code\n");
-				printf("%s", prompt);
-			} else {
-				invalid = false;
-			}
+// renders the telemetry as text or as JSON, it makes async-signal-safe calls only
+static size_t Util_Report (char *buf, size_t const size, bool const json)
+{
+	char *dst = buf;
+	const char *limit = buf + size;
+	m_stats_t total;
+	size_t bytes = 0;
+	size_t count = 0;
+	Util_Totals(&total, &bytes, &count);
+	const m_stats_t *stats = &total;
+	size_t const headers = stats->headers;
+	size_t const payload = (bytes > headers)? (bytes - headers) : 0;
+	size_t const overhead = (payload)? (1000 * headers + payload / 2) / payload : 0;
+	char ratio[] = "0.000";
+	ratio[0] = (char) ('0' + (overhead / 1000) % 10);
+	ratio[2] = (char) ('0' + (overhead / 100) % 10);
+	ratio[3] = (char) ('0' + (overhead / 10) % 10);
+	ratio[4] = (char) ('0' + overhead % 10);
+
+	if (json) {
+		dst = Util_Put(dst, limit, "{\"bytes\": ");
+		dst = Util_PutNumber(dst, limit, bytes);
+		dst = Util_Put(dst, limit, ", \"peak_bytes\": ");
+		dst = Util_PutNumber(dst, limit, stats->peak);
+		dst = Util_Put(dst, limit, ", \"objects\": ");
+		dst = Util_PutNumber(dst, limit, count);
+		dst = Util_Put(dst, limit, ", \"allocations\": ");
+		dst = Util_PutNumber(dst, limit, stats->allocations);
+		dst = Util_Put(dst, limit, ", \"header_bytes\": ");
+		dst = Util_PutNumber(dst, limit, headers);
+		dst = Util_Put(dst, limit, ", \"header_overhead\": ");
+		dst = Util_Put(dst, limit, ratio);
+		dst = Util_Put(dst, limit, ", \"types\": {");
+		for (size_t t = 0; t != M_TAGS; ++t) {
+			dst = Util_Put(dst, limit, (t)? ", \"" : "\"");
+			dst = Util_Put(dst, limit, _m_tags_[t]);
+			dst = Util_Put(dst, limit, "\": {\"objects\": ");
+			dst = Util_PutNumber(dst, limit, stats->objects[t]);
+			dst = Util_Put(dst, limit, ", \"bytes\": ");
+			dst = Util_PutNumber(dst, limit, stats->bytes[t]);
+			dst = Util_Put(dst, limit, "}");
 		}
+		dst = Util_Put(dst, limit, "}, \"classes\": [");
+		for (size_t c = 0; c != M_CLASSES; ++c) {
+			dst = Util_Put(dst, limit, (c)? ", {\"size\": " : "{\"size\": ");
+			dst = Util_PutNumber(dst, limit, ((size_t) 16) << c);
+			dst = Util_Put(dst, limit, ", \"objects\": ");
+			dst = Util_PutNumber(dst, limit, stats->classes[c]);
+			dst = Util_Put(dst, limit, "}");
+		}
+		dst = Util_Put(dst, limit, "]}\n");
+		return (dst - buf);
+	}
 
-	} while (chars == -1 || invalid);
+	dst = Util_Put(dst, limit, "MEMORY BYTES: ");
+	dst = Util_PutNumber(dst, limit, bytes);
+	dst = Util_Put(dst, limit, "\nMEMORY PEAK BYTES: ");
+	dst = Util_PutNumber(dst, limit, stats->peak);
+	dst = Util_Put(dst, limit, "\nMEMORY OBJECTS: ");
+	dst = Util_PutNumber(dst, limit, count);
+	dst = Util_Put(dst, limit, "\nMEMORY ALLOCATIONS: ");
+	dst = Util_PutNumber(dst, limit, stats->allocations);
+	dst = Util_Put(dst, limit, "\nMEMORY HEADER BYTES: ");
+	dst = Util_PutNumber(dst, limit, headers);
+	dst = Util_Put(dst, limit, "\nMEMORY HEADER OVERHEAD: ");
+	dst = Util_Put(dst, limit, ratio);
+	dst = Util_Put(dst, limit, "\n");
+	for (size_t t = 0; t != M_TAGS; ++t) {
+		dst = Util_Put(dst, limit, "MEMORY ");
+		dst = Util_Put(dst, limit, _m_tags_[t], true);
+		dst = Util_Put(dst, limit, ": ");
+		dst = Util_PutNumber(dst, limit, stats->objects[t]);
+		dst = Util_Put(dst, limit, " OBJECTS ");
+		dst = Util_PutNumber(dst, limit, stats->bytes[t]);
+		dst = Util_Put(dst, limit, " BYTES\n");
+	}
+
+	for (size_t c = 0; c != M_CLASSES; ++c) {
+		if (!stats->classes[c]) {
+			continue;
+		}
+		dst = Util_Put(dst, limit, "MEMORY CLASS ");
+		dst = Util_PutNumber(dst, limit, ((size_t) 16) << c);
+		dst = Util_Put(dst, limit, (c + 1 == M_CLASSES)? " AND OVER: " : ": ");
+		dst = Util_PutNumber(dst, limit, stats->classes[c]);
+		dst = Util_Put(dst, limit, "\n");
+	}
 
-	char *code = *_code_ ;
-	skipWhiteSpace(&code);
-	nullTrailWhiteSpace(&code);
-	memmove(*_code_, code, 1 + strlen(code));
+	return (dst - buf);
 }
 
-void ginfo (void)
+static void Util_Dump (int const fd, bool const json)
 {
-	size_t n = MAX_BUFFER_SIZE;
-	bool invalid = true;
-	ssize_t chars = 0;
-	char *text = NULL;
-	const char prompt[] = "Input the shoe description:";
-	printf("%s", prompt);
-	memset(*_info_, 0, MAX_BUFFER_SIZE);
-	do {
-		errno = 0;
-		chars = getline(_info_, &n, stdin);
-		if (chars == -1) {
-
-			if (errno) {
-				fprintf(stderr, "ginfo: %s\n", strerror(errno));
-				cleanup();
-				exit(EXIT_FAILURE);
-			}
-
-			clearerr(stdin);
-			printf("\nPlease input valid data\n");
-			printf("%s", prompt);
-
-		} else if (chars > MAX_STRING_LEN) {
-			invalid = true;
-			char msg[] = "The input exceeds max number of chars %d\n";
-			printf(msg, MAX_STRING_LEN);
-			*_info_ = (char*) realloc(*_info_, MAX_BUFFER_SIZE);
-			if (!*_info_) {
-				fprintf(stderr, "ginfo: %s\n", strerror(errno));
-				cleanup();
-				exit(EXIT_FAILURE);
-			}
-			memset(*_info_, 0, MAX_BUFFER_SIZE);
-			n = MAX_BUFFER_SIZE;
-			printf("%s", prompt);
-		} else {
-			text = *_info_ ;
-			skipWhiteSpace(&text);
-			if (!*text || *text == '\n') {
-				invalid = true;
-				printf("Please input a valid description\n");
-				printf("%s", prompt);
-			} else {
-				invalid = false;
+	char buf[M_REPORT_SIZE];
+	size_t const len = Util_Report(buf, sizeof(buf), json);
+	size_t done = 0;
+	while (done != len) {
+		ssize_t const bytes = write(fd, buf + done, len - done);
+		if (bytes == -1) {
+			if (errno == EINTR) {
+				continue;
 			}
+			return;
 		}
-
-	} while (chars == -1 || invalid);
-
-	char *info = *_info_ ;
-	skipWhiteSpace(&info);
-	nullTrailWhiteSpace(&info);
-	memmove(*_info_, info, 1 + strlen(info));
+		done += bytes;
+	}
 }
 
-void gsize (void)
+// replaces the stats file with a new one so that readers never see a partial report
+static void Util_StatsFile (const char *path)
 {
-	char prompt[] = "Input the shoe size:";
-	validData("gsize", prompt);
+	char temp[M_REPORT_SIZE];
+	size_t const len = strlen(path);
+	if (len + sizeof(".tmp") > sizeof(temp)) {
+		return;
+	}
+
+	memcpy(temp, path, len);
+	memcpy(temp + len, ".tmp", sizeof(".tmp"));
+	int const fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		return;
+	}
+
+	Util_Dump(fd, true);
+	close(fd);
+	rename(temp, path);
+}
+
+// dumps the telemetry on SIGUSR1, the counters may be caught in the middle of an update
+static void Util_Signal (int const sig)
+{
+	(void) sig;
+	int const err = errno;
+	Util_Dump(STDERR_FILENO, false);
+	if (_stats_) {
+		Util_StatsFile(_stats_);
+	}
+	errno = err;
+}
+
+Kind::Kind (kind_t const kind) : kind(kind)
+{
+	return;
+}
+
+kind_t Kind::k () const
+{
+	return this->kind;
+}
+
+const char *Kind::stringify (const Kind *kind)
+{
+	static const char *labels[KINDS] = {"A", "B", "C", "D", "E", "F", "G", "H"};
+	size_t const k = kind->k();
+	return (k < KINDS)? labels[k] : "?";
+}
+
+kind_t Kind::enumerator (const char *kind)
+{
+	if (kind[0] >= 'A' && kind[0] < ('A' + KINDS) && !kind[1]) {
+		return ((kind_t) (kind[0] - 'A'));
+	}
+
+	kind_t unknown = ((kind_t) 0xffffffff);
+	return unknown;
+}
+
+void *Kind::operator new (size_t size)
+{
+	return Util_PoolMalloc(size, M_KIND);
+}
+
+void Kind::operator delete (void *p)
+{
+	p = Util_Free(p);
+}
+
+Item::Item (char *code,
+            char *info,
+            char *avail,
+            double *size,
+            double *cost,
+            double *sale,
+            double *count,
+            Kind *kind)
+{
+	this->code = code;
+	this->info = info;
+	this->avail = avail;
+	this->size = size;
+	this->cost = cost;
+	this->sale = sale;
+	this->count = count;
+	this->kind = kind;
+}
+
+void Item::log () const
+{
+	_out_->field("REFERENCE", this->code);
+	_out_->field("DESCRIPTION", this->info);
+	_out_->field("SIZE", *this->size, 1);
+	_out_->text("AVAILABLE: ").put(*this->avail).put('\n');
+	_out_->field("COST", *this->cost, 2);
+	_out_->field("SALE", *this->sale, 2);
+	_out_->field("COUNT", *this->count, 0);
+	_out_->field("KIND", this->kind->stringify(this->kind));
+}
+
+void Item::total () const
+{
+	double const cost = *this->cost;
+	double const sale = *this->sale;
+	double const units = *this->count;
+	double const total_cost = units * cost;
+	double const total_sale = units * sale;
+	_out_->field("TOTAL COST", total_cost, 2);
+	_out_->text("TOTAL PROFIT OF ").fixed(units, 0).field(" UNITS", total_sale, 2);
+}
+
+// percentage of the part in the whole, zero when there is no whole (no items or no cost)
+static double percentage (double const part, double const whole)
+{
+	return (whole != 0)? (part / whole) * 100 : 0;
+}
+
+void Item::profit () const
+{
+	double const cost = *this->cost;
+	double const sale = *this->sale;
+	double const units = *this->count;
+	double const profit = (sale - cost);
+	double const total_cost = units * cost;
+	double const net_profit = units * (sale - cost);
+	_out_->field("PROFIT PER UNIT", profit, 2);
+	_out_->field("NET PROFIT", net_profit, 2);
+	_out_->field("PROFIT PERCENTAGE", percentage(net_profit, total_cost), 2);
+}
+
+void *Item::operator new (size_t size)
+{
+	return Util_PoolMalloc(size, M_ITEM);
+}
+
+void Item::operator delete (void *p)
+{
+	p = Util_Free(p);
+}
+
+static void stk_err_reserve ()
+{
+	fprintf(stderr, "Stack::reserve: error\n");
+}
+
+static void stk_err_add ()
+{
+	fprintf(stderr, "Stack::add: error\n");
+}
+
+template<typename T>
+Stack<T>::Stack (void)
+{
+	return;
+}
+
+template<typename T>
+Stack<T>::Stack (Stack &&stack)
+{
+	this->_begin_ = stack._begin_;
+	this->_avail_ = stack._avail_;
+	this->_limit_ = stack._limit_;
+	this->_borrowed_ = stack._borrowed_;
+	stack._begin_ = NULL;
+	stack._avail_ = NULL;
+	stack._limit_ = NULL;
+	stack._borrowed_ = false;
+}
+
+template<typename T>
+Stack<T>::~Stack ()
+{
+	this->clear();
+	if (!this->_borrowed_) {
+		this->_begin_ = (T*) Util_Free(this->_begin_);
+	}
+	this->_begin_ = NULL;
+	this->_avail_ = NULL;
+	this->_limit_ = NULL;
+}
+
+template<typename T>
+Stack<T> &Stack<T>::operator= (Stack &&stack)
+{
+	if (this != &stack) {
+		this->clear();
+		if (!this->_borrowed_) {
+			this->_begin_ = (T*) Util_Free(this->_begin_);
+		}
+		this->_begin_ = stack._begin_;
+		this->_avail_ = stack._avail_;
+		this->_limit_ = stack._limit_;
+		this->_borrowed_ = stack._borrowed_;
+		stack._begin_ = NULL;
+		stack._avail_ = NULL;
+		stack._limit_ = NULL;
+		stack._borrowed_ = false;
+	}
+
+	return *this;
+}
+
+template<typename T>
+size_t Stack<T>::cap () const
+{
+	return (this->_limit_ - this->_begin_);
+}
+
+template<typename T>
+size_t Stack<T>::numel () const
+{
+	return (this->_avail_ - this->_begin_);
+}
+
+template<typename T>
+size_t Stack<T>::bytes () const
+{
+	return (this->numel() * sizeof(T));
+}
+
+template<typename T>
+T *Stack<T>::begin ()
+{
+	return this->_begin_;
+}
+
+template<typename T>
+T *Stack<T>::end ()
+{
+	return this->_avail_;
+}
+
+template<typename T>
+const T *Stack<T>::begin () const
+{
+	return this->_begin_;
+}
+
+template<typename T>
+const T *Stack<T>::end () const
+{
+	return this->_avail_;
+}
+
+template<typename T>
+T &Stack<T>::operator[] (size_t const i)
+{
+	return this->_begin_[i];
+}
+
+template<typename T>
+const T &Stack<T>::operator[] (size_t const i) const
+{
+	return this->_begin_[i];
+}
+
+// moves the elements into a buffer of the requested capacity
+template<typename T>
+int Stack<T>::relocate (size_t const allot)
+{
+	int rc = 0;
+	size_t const numel = this->numel();
+	size_t const size = (allot)? allot * sizeof(T) : 1;
+	T *stack = NULL;
+	if (this->_borrowed_) {
+		// copies the borrowed elements out, the owner releases its buffer
+		stack = (T*) Util_Malloc(size, M_STACK);
+		if (!stack) {
+			rc = -1;
+			return rc;
+		}
+
+		memcpy((void*) stack, (const void*) this->_begin_, numel * sizeof(T));
+		this->_borrowed_ = false;
+	} else if (std::is_trivially_copyable<T>::value) {
+		stack = (T*) Util_Realloc(this->_begin_, size, M_STACK);
+		if (!stack) {
+			rc = -1;
+			return rc;
+		}
+	} else {
+		stack = (T*) Util_Malloc(size, M_STACK);
+		if (!stack) {
+			rc = -1;
+			return rc;
+		}
+
+		for (size_t i = 0; i != numel; ++i) {
+			::new ((void*) (stack + i)) T(std::move(this->_begin_[i]));
+			this->_begin_[i].~T();
+		}
+		this->_begin_ = (T*) Util_Free(this->_begin_);
+	}
+
+	this->_begin_ = stack;
+	this->_avail_ = stack + numel;
+	this->_limit_ = stack + allot;
+	return rc;
+}
+
+// grows geometrically so that adding n elements costs O(n) amortized
+template<typename T>
+int Stack<T>::grow (size_t const numel)
+{
+	size_t allot = (this->cap())? 2 * this->cap() : 8;
+	if (allot < numel) {
+		allot = numel;
+	}
+
+	return this->relocate(allot);
+}
+
+template<typename T>
+int Stack<T>::reserve (size_t const allot)
+{
+	int rc = 0;
+	if (allot <= this->cap()) {
+		return rc;
+	}
+
+	rc = this->relocate(allot);
+	if (rc != 0) {
+		stk_err_reserve();
+	}
+
+	return rc;
+}
+
+template<typename T>
+int Stack<T>::shrink_to_fit ()
+{
+	int rc = 0;
+	if (this->numel() == this->cap()) {
+		return rc;
+	}
+
+	rc = this->relocate(this->numel());
+	if (rc != 0) {
+		stk_err_reserve();
+	}
+
+	return rc;
+}
+
+template<typename T>
+int Stack<T>::add (const T &elem)
+{
+	int rc = 0;
+	if (this->_avail_ == this->_limit_) {
+		rc = this->grow(this->numel() + 1);
+		if (rc != 0) {
+			stk_err_add();
+			return rc;
+		}
+	}
+
+	::new ((void*) this->_avail_) T(elem);
+	++this->_avail_;
+	return rc;
+}
+
+template<typename T>
+int Stack<T>::add (T &&elem)
+{
+	int rc = 0;
+	if (this->_avail_ == this->_limit_) {
+		rc = this->grow(this->numel() + 1);
+		if (rc != 0) {
+			stk_err_add();
+			return rc;
+		}
+	}
+
+	::new ((void*) this->_avail_) T(std::move(elem));
+	++this->_avail_;
+	return rc;
+}
+
+template<typename T>
+int Stack<T>::append (const T *elems, size_t const numel)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "Stack::append: expects plain data");
+	int rc = 0;
+	size_t const total = this->numel() + numel;
+	if (total > this->cap()) {
+		rc = this->grow(total);
+		if (rc != 0) {
+			stk_err_add();
+			return rc;
+		}
+	}
+
+	memcpy((void*) this->_avail_, (const void*) elems, numel * sizeof(T));
+	this->_avail_ += numel;
+	return rc;
+}
+
+template<typename T>
+void Stack<T>::pop ()
+{
+	--this->_avail_;
+	this->_avail_->~T();
+}
+
+// adopts the elements of a buffer that outlives the stack, the first growth copies them out
+template<typename T>
+void Stack<T>::borrow (T *elems, size_t const numel)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "Stack::borrow: expects plain data");
+	this->clear();
+	if (!this->_borrowed_) {
+		this->_begin_ = (T*) Util_Free(this->_begin_);
+	}
+
+	this->_begin_ = elems;
+	this->_avail_ = elems + numel;
+	this->_limit_ = elems + numel;
+	this->_borrowed_ = true;
+}
+
+template<typename T>
+void Stack<T>::clear ()
+{
+	if (!std::is_trivially_destructible<T>::value) {
+		for (T *it = this->_begin_; it != this->_avail_; ++it) {
+			it->~T();
+		}
+	}
+
+	this->_avail_ = this->_begin_;
+}
+
+template<typename T>
+void *Stack<T>::operator new (size_t size)
+{
+	return Util_PoolMalloc(size, M_STACK);
+}
+
+template<typename T>
+void Stack<T>::operator delete (void *p)
+{
+	p = Util_Free(p);
+}
+
+// FNV-1a hash of the reference code, never zero so that it does not mark a slot empty
+static size_t hashCode (const char *code)
+{
+	size_t hash = 0xcbf29ce484222325;
+	for (const char *c = code; *c; ++c) {
+		hash ^= (unsigned char) *c;
+		hash *= 0x00000100000001b3;
+	}
+
+	return (hash)? hash : 1;
+}
+
+static void idx_err_rehash ()
+{
+	fprintf(stderr, "CodeIndex::rehash: error\n");
+}
+
+CodeIndex::CodeIndex (void)
+{
+	return;
+}
+
+size_t CodeIndex::numel () const
+{
+	return this->_numel_;
+}
+
+size_t CodeIndex::bytes () const
+{
+	return (this->_slots_)? (this->_mask_ + 1) * sizeof(slot_t) : 0;
+}
+
+// places the slot in the table, the slot that is closer to its home yields its position
+void CodeIndex::place (slot_t slot)
+{
+	size_t const mask = this->_mask_;
+	size_t i = (slot.hash & mask);
+	size_t dist = 0;
+	while (this->_slots_[i].hash) {
+		size_t const d = (i - (this->_slots_[i].hash & mask)) & mask;
+		if (d < dist) {
+			slot_t const rich = this->_slots_[i];
+			this->_slots_[i] = slot;
+			slot = rich;
+			dist = d;
+		}
+		i = (i + 1) & mask;
+		++dist;
+	}
+
+	this->_slots_[i] = slot;
+}
+
+int CodeIndex::rehash (size_t const allot)
+{
+	int rc = 0;
+	size_t const size = allot * sizeof(slot_t);
+	slot_t *slots = (slot_t*) Util_Malloc(size, M_INDEX);
+	if (!slots) {
+		rc = -1;
+		idx_err_rehash();
+		return rc;
+	}
+
+	memset(slots, 0, size);
+	slot_t *prev = this->_slots_;
+	size_t const prev_allot = (prev)? (this->_mask_ + 1) : 0;
+	this->_slots_ = slots;
+	this->_mask_ = (allot - 1);
+	for (size_t i = 0; i != prev_allot; ++i) {
+		if (prev[i].hash) {
+			this->place(prev[i]);
+		}
+	}
+
+	prev = (slot_t*) Util_Free(prev);
+	return rc;
+}
+
+// sizes the table for the number of keys with a load factor of at most 7/8
+int CodeIndex::reserve (size_t const numel)
+{
+	size_t allot = 16;
+	while (8 * numel > 7 * allot) {
+		allot *= 2;
+	}
+
+	if (this->_slots_ && allot <= (this->_mask_ + 1)) {
+		return 0;
+	}
+
+	return this->rehash(allot);
+}
+
+size_t CodeIndex::find (const char *code,
+			size_t const hash,
+			const char *heap,
+			const size_t *codes) const
+{
+	if (!this->_slots_) {
+		return NPOS;
+	}
+
+	size_t const mask = this->_mask_;
+	size_t i = (hash & mask);
+	size_t dist = 0;
+	while (this->_slots_[i].hash) {
+		slot_t const slot = this->_slots_[i];
+		// the key would have displaced a slot closer to its home
+		if (((i - (slot.hash & mask)) & mask) < dist) {
+			return NPOS;
+		}
+
+		if (slot.hash == hash && !strcmp(heap + codes[slot.row], code)) {
+			return slot.row;
+		}
+
+		i = (i + 1) & mask;
+		++dist;
+	}
+
+	return NPOS;
+}
+
+int CodeIndex::insert (size_t const hash, size_t const row)
+{
+	int rc = this->reserve(this->_numel_ + 1);
+	if (rc != 0) {
+		return rc;
+	}
+
+	slot_t const slot = {hash, row};
+	this->place(slot);
+	++this->_numel_;
+	return rc;
+}
+
+// removes the slot and shifts the slots that follow it back towards their homes
+int CodeIndex::erase (size_t const hash, size_t const row)
+{
+	int rc = -1;
+	if (!this->_slots_) {
+		return rc;
+	}
+
+	size_t const mask = this->_mask_;
+	size_t i = (hash & mask);
+	while (this->_slots_[i].hash) {
+		if (this->_slots_[i].hash == hash && this->_slots_[i].row == row) {
+			size_t next = (i + 1) & mask;
+			while (this->_slots_[next].hash && (next - (this->_slots_[next].hash & mask)) & mask) {
+				this->_slots_[i] = this->_slots_[next];
+				i = next;
+				next = (next + 1) & mask;
+			}
+
+			this->_slots_[i].hash = 0;
+			this->_slots_[i].row = 0;
+			--this->_numel_;
+			rc = 0;
+			return rc;
+		}
+		i = (i + 1) & mask;
+	}
+
+	return rc;
+}
+
+// points the slot of the row to the row that takes its place
+int CodeIndex::relink (size_t const hash, size_t const row, size_t const dest)
+{
+	int rc = -1;
+	if (!this->_slots_) {
+		return rc;
+	}
+
+	size_t const mask = this->_mask_;
+	size_t i = (hash & mask);
+	while (this->_slots_[i].hash) {
+		if (this->_slots_[i].hash == hash && this->_slots_[i].row == row) {
+			this->_slots_[i].row = dest;
+			rc = 0;
+			return rc;
+		}
+		i = (i + 1) & mask;
+	}
+
+	return rc;
+}
+
+void CodeIndex::clear ()
+{
+	if (this->_slots_) {
+		memset(this->_slots_, 0, (this->_mask_ + 1) * sizeof(slot_t));
+	}
+
+	this->_numel_ = 0;
+}
+
+void *CodeIndex::operator new (size_t size)
+{
+	return Util_PoolMalloc(size, M_INDEX);
+}
+
+void CodeIndex::operator delete (void *p)
+{
+	p = Util_Free(p);
+}
+
+// entries are ordered by key and ties are broken by row
+static bool bt_less (double const key, size_t const row, double const k, size_t const r)
+{
+	return ((key < k) || (key == k && row < r));
+}
+
+// number of entries of the node that precede the entry
+static size_t bt_lower (const bnode_t *node, double const key, size_t const row)
+{
+	size_t lo = 0;
+	size_t hi = node->numel;
+	while (lo < hi) {
+		size_t const mid = lo + (hi - lo) / 2;
+		if (bt_less(node->keys[mid], node->rows[mid], key, row)) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+// number of entries of the node that precede or equal the entry
+static size_t bt_upper (const bnode_t *node, double const key, size_t const row)
+{
+	size_t lo = 0;
+	size_t hi = node->numel;
+	while (lo < hi) {
+		size_t const mid = lo + (hi - lo) / 2;
+		if (!bt_less(key, row, node->keys[mid], node->rows[mid])) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+static void bt_err_insert ()
+{
+	fprintf(stderr, "OrderedIndex::insert: error\n");
+}
+
+OrderedIndex::OrderedIndex (void)
+{
+	return;
+}
+
+size_t OrderedIndex::numel () const
+{
+	return this->_numel_;
+}
+
+size_t OrderedIndex::bytes () const
+{
+	return (this->_nodes_ * sizeof(bnode_t));
+}
+
+bnode_t *OrderedIndex::node (bool const leaf)
+{
+	bnode_t *node = (bnode_t*) Util_Malloc(sizeof(bnode_t), M_INDEX);
+	if (!node) {
+		return NULL;
+	}
+
+	node->numel = 0;
+	node->leaf = leaf;
+	node->prev = NULL;
+	node->next = NULL;
+	++this->_nodes_;
+	return node;
+}
+
+// inserts the entry in the subtree, a node that overflows is split and its right half returned
+// along with the entry that separates it from the left half
+int OrderedIndex::insertAt (bnode_t *node,
+			    double const key,
+			    size_t const row,
+			    bnode_t **right,
+			    double *sep_key,
+			    size_t *sep_row)
+{
+	int rc = 0;
+	*right = NULL;
+	if (node->leaf) {
+		size_t const pos = bt_lower(node, key, row);
+		size_t const tail = node->numel - pos;
+		memmove(node->keys + pos + 1, node->keys + pos, tail * sizeof(double));
+		memmove(node->rows + pos + 1, node->rows + pos, tail * sizeof(size_t));
+		node->keys[pos] = key;
+		node->rows[pos] = row;
+		++node->numel;
+		if (node->numel <= BTREE_ORDER) {
+			return rc;
+		}
+
+		bnode_t *sibling = this->node(true);
+		if (!sibling) {
+			rc = -1;
+			return rc;
+		}
+
+		size_t const half = node->numel / 2;
+		size_t const moved = node->numel - half;
+		memcpy(sibling->keys, node->keys + half, moved * sizeof(double));
+		memcpy(sibling->rows, node->rows + half, moved * sizeof(size_t));
+		sibling->numel = moved;
+		node->numel = half;
+
+		sibling->prev = node;
+		sibling->next = node->next;
+		if (node->next) {
+			node->next->prev = sibling;
+		} else {
+			this->_tail_ = sibling;
+		}
+		node->next = sibling;
+		*right = sibling;
+		*sep_key = sibling->keys[0];
+		*sep_row = sibling->rows[0];
+		return rc;
+	}
+
+	size_t const pos = bt_upper(node, key, row);
+	bnode_t *split = NULL;
+	double split_key = 0;
+	size_t split_row = 0;
+	rc = this->insertAt(node->child[pos], key, row, &split, &split_key, &split_row);
+	if (rc != 0 || !split) {
+		return rc;
+	}
+
+	size_t const tail = node->numel - pos;
+	memmove(node->keys + pos + 1, node->keys + pos, tail * sizeof(double));
+	memmove(node->rows + pos + 1, node->rows + pos, tail * sizeof(size_t));
+	memmove(node->child + pos + 2, node->child + pos + 1, tail * sizeof(bnode_t*));
+	node->keys[pos] = split_key;
+	node->rows[pos] = split_row;
+	node->child[pos + 1] = split;
+	++node->numel;
+	if (node->numel <= BTREE_ORDER) {
+		return rc;
+	}
+
+	bnode_t *sibling = this->node(false);
+	if (!sibling) {
+		rc = -1;
+		return rc;
+	}
+
+	// the middle separator moves up to the parent
+	size_t const mid = node->numel / 2;
+	size_t const moved = node->numel - mid - 1;
+	memcpy(sibling->keys, node->keys + mid + 1, moved * sizeof(double));
+	memcpy(sibling->rows, node->rows + mid + 1, moved * sizeof(size_t));
+	memcpy(sibling->child, node->child + mid + 1, (moved + 1) * sizeof(bnode_t*));
+	sibling->numel = moved;
+	node->numel = mid;
+	*right = sibling;
+	*sep_key = node->keys[mid];
+	*sep_row = node->rows[mid];
+	return rc;
+}
+
+int OrderedIndex::insert (double const key, size_t const row)
+{
+	int rc = 0;
+	if (!this->_root_) {
+		this->_root_ = this->node(true);
+		if (!this->_root_) {
+			rc = -1;
+			bt_err_insert();
+			return rc;
+		}
+		this->_head_ = this->_root_;
+		this->_tail_ = this->_root_;
+	}
+
+	bnode_t *right = NULL;
+	double sep_key = 0;
+	size_t sep_row = 0;
+	rc = this->insertAt(this->_root_, key, row, &right, &sep_key, &sep_row);
+	if (rc != 0) {
+		bt_err_insert();
+		return rc;
+	}
+
+	if (right) {
+		bnode_t *root = this->node(false);
+		if (!root) {
+			rc = -1;
+			bt_err_insert();
+			return rc;
+		}
+
+		root->keys[0] = sep_key;
+		root->rows[0] = sep_row;
+		root->child[0] = this->_root_;
+		root->child[1] = right;
+		root->numel = 1;
+		this->_root_ = root;
+	}
+
+	++this->_numel_;
+	return rc;
+}
+
+int OrderedIndex::erase (double const key, size_t const row)
+{
+	int rc = -1;
+	bnode_t *node = this->_root_;
+	if (!node) {
+		return rc;
+	}
+
+	while (!node->leaf) {
+		node = node->child[bt_upper(node, key, row)];
+	}
+
+	size_t const pos = bt_lower(node, key, row);
+	if (pos == node->numel || node->keys[pos] != key || node->rows[pos] != row) {
+		fprintf(stderr, "OrderedIndex::erase: error\n");
+		return rc;
+	}
+
+	size_t const tail = node->numel - pos - 1;
+	memmove(node->keys + pos, node->keys + pos + 1, tail * sizeof(double));
+	memmove(node->rows + pos, node->rows + pos + 1, tail * sizeof(size_t));
+	--node->numel;
+	--this->_numel_;
+	rc = 0;
+	return rc;
+}
+
+// positions the cursor at the first entry whose key is not less than the given key
+cursor_t OrderedIndex::lower (double const key) const
+{
+	cursor_t cursor = {NULL, 0};
+	bnode_t *node = this->_root_;
+	if (!node) {
+		return cursor;
+	}
+
+	while (!node->leaf) {
+		node = node->child[bt_upper(node, key, 0)];
+	}
+
+	cursor.leaf = node;
+	cursor.pos = bt_lower(node, key, 0);
+	if (cursor.pos == node->numel) {
+		cursor.pos = node->numel - 1;
+		this->next(&cursor);
+	}
+
+	return cursor;
+}
+
+cursor_t OrderedIndex::first () const
+{
+	cursor_t cursor = {this->_head_, 0};
+	while (cursor.leaf && !cursor.leaf->numel) {
+		cursor.leaf = cursor.leaf->next;
+	}
+
+	return cursor;
+}
+
+cursor_t OrderedIndex::last () const
+{
+	cursor_t cursor = {this->_tail_, 0};
+	while (cursor.leaf && !cursor.leaf->numel) {
+		cursor.leaf = cursor.leaf->prev;
+	}
+
+	if (cursor.leaf) {
+		cursor.pos = cursor.leaf->numel - 1;
+	}
+
+	return cursor;
+}
+
+void OrderedIndex::next (cursor_t *cursor) const
+{
+	++cursor->pos;
+	while (cursor->leaf && cursor->pos >= cursor->leaf->numel) {
+		cursor->leaf = cursor->leaf->next;
+		cursor->pos = 0;
+	}
+}
+
+void OrderedIndex::prev (cursor_t *cursor) const
+{
+	while (cursor->leaf && !cursor->pos) {
+		cursor->leaf = cursor->leaf->prev;
+		cursor->pos = (cursor->leaf)? cursor->leaf->numel : 0;
+	}
+
+	if (cursor->leaf) {
+		--cursor->pos;
+	}
+}
+
+static void bt_free (bnode_t *node)
+{
+	if (!node->leaf) {
+		for (size_t i = 0; i <= node->numel; ++i) {
+			bt_free(node->child[i]);
+		}
+	}
+
+	node = (bnode_t*) Util_Free(node);
+}
+
+void OrderedIndex::clear ()
+{
+	if (this->_root_) {
+		bt_free(this->_root_);
+	}
+
+	this->_root_ = NULL;
+	this->_head_ = NULL;
+	this->_tail_ = NULL;
+	this->_numel_ = 0;
+	this->_nodes_ = 0;
+}
+
+void *OrderedIndex::operator new (size_t size)
+{
+	return Util_PoolMalloc(size, M_INDEX);
+}
+
+void OrderedIndex::operator delete (void *p)
+{
+	p = Util_Free(p);
+}
+
+static void tbl_err_reserve ()
+{
+	fprintf(stderr, "ItemTable::reserve: error\n");
+}
+
+static void tbl_err_add ()
+{
+	fprintf(stderr, "ItemTable::add: error\n");
+}
+
+static void tbl_err_erase ()
+{
+	fprintf(stderr, "ItemTable::erase: error\n");
+}
+
+// adds the term to the compensated sum (Neumaier's variant of Kahan summation [6])
+static void ksum (ksum_t *s, double const x)
+{
+	double const t = s->sum + x;
+	if (fabs(s->sum) >= fabs(x)) {
+		s->comp += (s->sum - t) + x;
+	} else {
+		s->comp += (x - t) + s->sum;
+	}
+
+	s->sum = t;
+}
+
+static double kval (const ksum_t *s)
+{
+	return (s->sum + s->comp);
+}
+
+// the kinds of a snapshot index the arrays by kind, one out of range is caught before its use
+static void kindErr (const char *fname)
+{
+	fprintf(stderr, "%s: kind out of range, corrupted snapshot\n", fname);
+	cleanup();
+	exit(EXIT_FAILURE);
+}
+
+// adds the item to its group, groups[2 * kind] holds the unavailable items and the next one the rest
+static inline void groupAdd (group_t *groups,
+			     double const cost,
+			     double const sale,
+			     double const units,
+			     size_t const kind,
+			     char const avail)
+{
+	// the buckets are (lo, hi] like the bands, a cost on a bound goes to the bucket below it
+	double const band = ceil(cost / HIST_WIDTH) - 1;
+	double const last = (HIST_BUCKETS - 1);
+	size_t const bucket = (band > 0)? (size_t) ((band < last)? band : last) : 0;
+	if (kind >= KINDS) {
+		kindErr("groupAdd");
+	}
+
+	group_t *grp = &groups[2 * kind + (avail == 'Y')];
+	if (!grp->items || cost < grp->min_cost) {
+		grp->min_cost = cost;
+	}
+
+	if (!grp->items || cost > grp->max_cost) {
+		grp->max_cost = cost;
+	}
+
+	++grp->items;
+	grp->units += units;
+	grp->cost += units * cost;
+	grp->sale += units * sale;
+	grp->sum_cost += cost;
+	++grp->hist[bucket];
+}
+
+ItemTable::ItemTable (void)
+{
+	return;
+}
+
+size_t ItemTable::numel () const
+{
+	return this->_numel_;
+}
+
+size_t ItemTable::bytes () const
+{
+	return (this->_cost_.cap() * sizeof(double) +
+		this->_sale_.cap() * sizeof(double) +
+		this->_count_.cap() * sizeof(double) +
+		this->_size_.cap() * sizeof(double) +
+		this->_kind_.cap() * sizeof(Kind) +
+		this->_avail_.cap() * sizeof(char) +
+		this->_code_.cap() * sizeof(size_t) +
+		this->_info_.cap() * sizeof(size_t) +
+		this->_heap_.cap() * sizeof(char) +
+		this->_index_.bytes() +
+		this->_by_cost_.bytes() +
+		this->_by_sale_.bytes() +
+		this->_by_profit_.bytes());
+}
+
+// the columns reach the capacity at once, bulk loads should reserve the rows they expect
+int ItemTable::reserve (size_t const allot)
+{
+	int rc = 0;
+	if ((rc = this->_cost_.reserve(allot)) != 0 ||
+	    (rc = this->_sale_.reserve(allot)) != 0 ||
+	    (rc = this->_count_.reserve(allot)) != 0 ||
+	    (rc = this->_size_.reserve(allot)) != 0 ||
+	    (rc = this->_kind_.reserve(allot)) != 0 ||
+	    (rc = this->_avail_.reserve(allot)) != 0 ||
+	    (rc = this->_code_.reserve(allot)) != 0 ||
+	    (rc = this->_info_.reserve(allot)) != 0 ||
+	    (rc = this->_index_.reserve(allot)) != 0) {
+		tbl_err_reserve();
+	}
+
+	return rc;
+}
+
+int ItemTable::shrink_to_fit ()
+{
+	int rc = 0;
+	if ((rc = this->_cost_.shrink_to_fit()) != 0 ||
+	    (rc = this->_sale_.shrink_to_fit()) != 0 ||
+	    (rc = this->_count_.shrink_to_fit()) != 0 ||
+	    (rc = this->_size_.shrink_to_fit()) != 0 ||
+	    (rc = this->_kind_.shrink_to_fit()) != 0 ||
+	    (rc = this->_avail_.shrink_to_fit()) != 0 ||
+	    (rc = this->_code_.shrink_to_fit()) != 0 ||
+	    (rc = this->_info_.shrink_to_fit()) != 0 ||
+	    (rc = this->_heap_.shrink_to_fit()) != 0) {
+		tbl_err_reserve();
+	}
+
+	return rc;
+}
+
+int ItemTable::add (const char *code,
+		    const char *info,
+		    char const avail,
+		    double const size,
+		    double const cost,
+		    double const sale,
+		    double const count,
+		    kind_t const kind)
+{
+	int rc = 0;
+	size_t const numel = this->_numel_;
+	if (numel == this->_cost_.cap()) {
+		// grows every column up front so that the row is never added partially
+		rc = this->reserve((numel)? 2 * numel : 8);
+		if (rc != 0) {
+			goto err;
+		}
+	}
+
+	{
+		size_t const code_sz = strlen(code) + 1;
+		size_t const info_sz = strlen(info) + 1;
+		size_t const offset = this->_heap_.numel();
+		size_t const heap_sz = offset + code_sz + info_sz;
+		if (heap_sz > this->_heap_.cap()) {
+			rc = this->_heap_.grow(heap_sz);
+			if (rc != 0) {
+				goto err;
+			}
+		}
+
+		this->_heap_.append(code, code_sz);
+		this->_heap_.append(info, info_sz);
+		this->_code_.add(offset);
+		this->_info_.add(offset + code_sz);
+	}
+
+	this->_cost_.add(cost);
+	this->_sale_.add(sale);
+	this->_count_.add(count);
+	this->_size_.add(size);
+	this->_kind_.add(Kind(kind));
+	this->_avail_.add(avail);
+	++this->_numel_;
+	this->account(this->_numel_ - 1, 1);
+
+	// the indexes of attached rows are built all at once later on
+	if (this->_indexed_) {
+		size_t const row = (this->_numel_ - 1);
+		if ((rc = this->_by_cost_.insert(cost, row)) != 0 ||
+		    (rc = this->_by_sale_.insert(sale, row)) != 0 ||
+		    (rc = this->_by_profit_.insert(sale - cost, row)) != 0) {
+			goto err;
+		}
+	}
+
+	return rc;
+
+err:
+	tbl_err_add();
+	return rc;
+}
+
+// string at the offset into the heap, the offsets read from a snapshot are only trusted up to the
+// heap size, which is known to end in a NUL
+char *ItemTable::text (size_t const offset)
+{
+	if (offset >= this->_heap_.numel()) {
+		fprintf(stderr, "ItemTable::text: string offset out of bounds, corrupted snapshot\n");
+		cleanup();
+		exit(EXIT_FAILURE);
+	}
+
+	return this->_heap_.begin() + offset;
+}
+
+// builds the indexes of the rows attached from a snapshot on first use
+int ItemTable::index ()
+{
+	int rc = 0;
+	if (this->_indexed_ && !this->_priced_) {
+		for (size_t i = 0; i != this->_numel_; ++i) {
+			double const cost = this->_cost_[i];
+			double const sale = this->_sale_[i];
+			if ((rc = this->_by_sale_.insert(sale, i)) != 0 ||
+			    (rc = this->_by_profit_.insert(sale - cost, i)) != 0) {
+				fprintf(stderr, "ItemTable::index: error\n");
+				return rc;
+			}
+		}
+
+		this->_priced_ = true;
+		return rc;
+	}
+
+	if (this->_indexed_) {
+		return rc;
+	}
+
+	size_t const numel = this->_numel_;
+	rc = this->_index_.reserve(numel);
+	if (rc != 0) {
+		return rc;
+	}
+
+	for (size_t i = 0; i != numel; ++i) {
+		double const cost = this->_cost_[i];
+		double const sale = this->_sale_[i];
+		if ((rc = this->_index_.insert(hashCode(this->text(this->_code_[i])), i)) != 0 ||
+		    (rc = this->_by_cost_.insert(cost, i)) != 0 ||
+		    (rc = this->_by_sale_.insert(sale, i)) != 0 ||
+		    (rc = this->_by_profit_.insert(sale - cost, i)) != 0) {
+			fprintf(stderr, "ItemTable::index: error\n");
+			return rc;
+		}
+	}
+
+	this->_indexed_ = true;
+	return rc;
+}
+
+// adopts the columns of a mapped snapshot, private pages are copied on write
+void ItemTable::attach (const snapshot_t *snapshot, char *base)
+{
+	size_t const numel = snapshot->numel;
+	this->_cost_.borrow((double*) (base + snapshot->offset[0]), numel);
+	this->_sale_.borrow((double*) (base + snapshot->offset[1]), numel);
+	this->_count_.borrow((double*) (base + snapshot->offset[2]), numel);
+	this->_size_.borrow((double*) (base + snapshot->offset[3]), numel);
+	this->_kind_.borrow((Kind*) (base + snapshot->offset[4]), numel);
+	this->_avail_.borrow((char*) (base + snapshot->offset[5]), numel);
+	this->_code_.borrow((size_t*) (base + snapshot->offset[6]), numel);
+	this->_info_.borrow((size_t*) (base + snapshot->offset[7]), numel);
+	this->_heap_.borrow((char*) (base + snapshot->offset[8]), snapshot->heap);
+	this->_index_.clear();
+	this->_numel_ = numel;
+	this->_lsn_ = snapshot->lsn;
+	this->_indexed_ = (numel == 0);
+	memcpy(this->_totals_, snapshot->totals, sizeof(this->_totals_));
+}
+
+// moves the last row into the erased one, the strings of the erased row stay in the heap
+int ItemTable::erase (size_t const i)
+{
+	int rc = this->index();
+	if (rc != 0) {
+		tbl_err_erase();
+		return rc;
+	}
+
+	const char *heap = this->_heap_.begin();
+	double const cost = this->_cost_[i];
+	double const sale = this->_sale_[i];
+	this->account(i, -1);
+	if ((rc = this->_by_cost_.erase(cost, i)) != 0 ||
+	    (rc = this->_by_sale_.erase(sale, i)) != 0 ||
+	    (rc = this->_by_profit_.erase(sale - cost, i)) != 0 ||
+	    (rc = this->_index_.erase(hashCode(heap + this->_code_[i]), i)) != 0) {
+		tbl_err_erase();
+		return rc;
+	}
+
+	size_t const last = (this->_numel_ - 1);
+	if (i != last) {
+		double const last_cost = this->_cost_[last];
+		double const last_sale = this->_sale_[last];
+		if ((rc = this->_by_cost_.erase(last_cost, last)) != 0 ||
+		    (rc = this->_by_cost_.insert(last_cost, i)) != 0 ||
+		    (rc = this->_by_sale_.erase(last_sale, last)) != 0 ||
+		    (rc = this->_by_sale_.insert(last_sale, i)) != 0 ||
+		    (rc = this->_by_profit_.erase(last_sale - last_cost, last)) != 0 ||
+		    (rc = this->_by_profit_.insert(last_sale - last_cost, i)) != 0 ||
+		    (rc = this->_index_.relink(hashCode(heap + this->_code_[last]), last, i)) != 0) {
+			tbl_err_erase();
+			return rc;
+		}
+
+		this->_cost_[i] = last_cost;
+		this->_sale_[i] = last_sale;
+		this->_count_[i] = this->_count_[last];
+		this->_size_[i] = this->_size_[last];
+		this->_kind_[i] = this->_kind_[last];
+		this->_avail_[i] = this->_avail_[last];
+		this->_code_[i] = this->_code_[last];
+		this->_info_[i] = this->_info_[last];
+	}
+
+	this->_cost_.pop();
+	this->_sale_.pop();
+	this->_count_.pop();
+	this->_size_.pop();
+	this->_kind_.pop();
+	this->_avail_.pop();
+	this->_code_.pop();
+	this->_info_.pop();
+	--this->_numel_;
+	return rc;
+}
+
+size_t ItemTable::find (const char *code)
+{
+	if (this->index() != 0) {
+		return NPOS;
+	}
+
+	return this->_index_.find(code, hashCode(code), this->_heap_.begin(), this->_code_.begin());
+}
+
+// adds the item or, if the reference code is known, merges the count and refreshes the prices
+int ItemTable::upsert (const char *code,
+		       const char *info,
+		       char const avail,
+		       double const size,
+		       double const cost,
+		       double const sale,
+		       double const count,
+		       kind_t const kind,
+		       size_t *row)
+{
+	int rc = this->index();
+	if (rc != 0) {
+		tbl_err_add();
+		return rc;
+	}
+
+	size_t const hash = hashCode(code);
+	size_t const i = this->_index_.find(code,
+					    hash,
+					    this->_heap_.begin(),
+					    this->_code_.begin());
+	if (i != NPOS) {
+		double const prev_cost = this->_cost_[i];
+		double const prev_sale = this->_sale_[i];
+		if (prev_cost != cost) {
+			this->_by_cost_.erase(prev_cost, i);
+			rc = this->_by_cost_.insert(cost, i);
+		}
+
+		if (rc == 0 && prev_sale != sale) {
+			this->_by_sale_.erase(prev_sale, i);
+			rc = this->_by_sale_.insert(sale, i);
+		}
+
+		if (rc == 0 && (prev_sale - prev_cost) != (sale - cost)) {
+			this->_by_profit_.erase(prev_sale - prev_cost, i);
+			rc = this->_by_profit_.insert(sale - cost, i);
+		}
+
+		if (rc != 0) {
+			tbl_err_add();
+			return rc;
+		}
+
+		this->account(i, -1);
+		this->_count_[i] += count;
+		this->_cost_[i] = cost;
+		this->_sale_[i] = sale;
+		this->_kind_[i] = Kind(kind);
+		this->_avail_[i] = avail;
+		this->account(i, 1);
+		*row = i;
+		return rc;
+	}
+
+	rc = this->add(code, info, avail, size, cost, sale, count, kind);
+	if (rc != 0) {
+		return rc;
+	}
+
+	*row = (this->_numel_ - 1);
+	rc = this->_index_.insert(hash, *row);
+	if (rc != 0) {
+		tbl_err_add();
+	}
+
+	return rc;
+}
+
+// adds (or subtracts with a negative sign) the contribution of the row to the running totals
+void ItemTable::account (size_t const i, double const sign)
+{
+	double const cost = this->_cost_[i];
+	double const sale = this->_sale_[i];
+	double const units = sign * this->_count_[i];
+	size_t const kind = this->_kind_[i].k();
+	if (kind >= KINDS) {
+		kindErr("ItemTable::account");
+	}
+
+	totals_t *totals = &this->_totals_[kind];
+	ksum(&totals->profit, units * (sale - cost));
+	ksum(&totals->expenses, units * cost);
+	ksum(&totals->units, units);
+}
+
+// counts the item in the running totals and in its group and drops it (streaming mode), the
+// memory stays the same no matter how many items are folded
+void ItemTable::fold (double const cost,
+		      double const sale,
+		      double const count,
+		      kind_t const kind,
+		      char const avail)
+{
+	totals_t *totals = &this->_totals_[kind];
+	ksum(&totals->profit, count * (sale - cost));
+	ksum(&totals->expenses, count * cost);
+	ksum(&totals->units, count);
+	groupAdd(this->_groups_, cost, sale, count, kind, avail);
+	++this->_folded_;
+}
+
+void ItemTable::totals (double *profit, double *expenses, double *units) const
+{
+	ksum_t p = {0, 0};
+	ksum_t e = {0, 0};
+	ksum_t u = {0, 0};
+	for (int k = 0; k != KINDS; ++k) {
+		const totals_t *totals = &this->_totals_[k];
+		ksum(&p, totals->profit.sum);
+		ksum(&p, totals->profit.comp);
+		ksum(&e, totals->expenses.sum);
+		ksum(&e, totals->expenses.comp);
+		ksum(&u, totals->units.sum);
+		ksum(&u, totals->units.comp);
+	}
+
+	*profit = kval(&p);
+	*expenses = kval(&e);
+	*units = kval(&u);
+}
+
+Item ItemTable::row (size_t const i)
+{
+	return Item(this->text(this->_code_[i]),
+		    this->text(this->_info_[i]),
+		    this->_avail_.begin() + i,
+		    this->_size_.begin() + i,
+		    this->_cost_.begin() + i,
+		    this->_sale_.begin() + i,
+		    this->_count_.begin() + i,
+		    this->_kind_.begin() + i);
+}
+
+void *ItemTable::operator new (size_t size)
+{
+	return Util_PoolMalloc(size);
+}
+
+void ItemTable::operator delete (void *p)
+{
+	p = Util_Free(p);
+}
+
+void init (void)
+{
+	size_t const sz = MAX_BUFFER_SIZE;
+	*_temp_ = (char*) Util_Malloc(sz, M_BUFFER);
+	if (!*_temp_) {
+		fprintf(stderr, "init: %s\n", strerror(errno));
+		cleanup();
+		exit(EXIT_FAILURE);
+	}
+
+	*_code_ = (char*) Util_Malloc(sz, M_BUFFER);
+	if (!*_code_) {
+		fprintf(stderr, "init: %s\n", strerror(errno));
+		cleanup();
+		exit(EXIT_FAILURE);
+	}
+
+	*_info_ = (char*) Util_Malloc(sz, M_BUFFER);
+	if (!*_info_) {
+		fprintf(stderr, "init: %s\n", strerror(errno));
+		cleanup();
+		exit(EXIT_FAILURE);
+	}
+
+	_out_ = new Writer();
+	if (!_out_ || _out_->open(STDOUT_FILENO, WRITER_BUFFER_SIZE) != 0) {
+		_out_ = NULL;
+		fprintf(stderr, "init: %s\n", strerror(errno));
+		cleanup();
+		exit(EXIT_FAILURE);
+	}
+
+	_in_ = new Reader();
+	if (!_in_ || _in_->open(STDIN_FILENO, READER_BUFFER_SIZE) != 0) {
+		_in_ = NULL;
+		fprintf(stderr, "init: %s\n", strerror(errno));
+		cleanup();
+		exit(EXIT_FAILURE);
+	}
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = Util_Signal;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGUSR1, &sa, NULL) == -1) {
+		fprintf(stderr, "init: %s\n", strerror(errno));
+		cleanup();
+		exit(EXIT_FAILURE);
+	}
+
+	_locale_ = newlocale(LC_ALL_MASK, "C", (locale_t) 0);
+	if (_locale_ == (locale_t) 0) {
+		fprintf(stderr, "init: %s\n", strerror(errno));
+		cleanup();
+		exit(EXIT_FAILURE);
+	}
+
+	dispatch();
+	if (_pricing_path_) {
+		pricing(_pricing_path_);
+	}
+}
+
+static void pricingErr (const char *path, size_t const lineno, const char *msg)
+{
+	fprintf(stderr, "pricing: %s: line %zu: %s\n", path, lineno, msg);
+	cleanup();
+	exit(EXIT_FAILURE);
+}
+
+// parseNumber() expects whitespace after the number, the tokens end at their null terminator
+static bool pricingNumber (const char *token, double *number)
+{
+	char text[MAX_BUFFER_SIZE];
+	size_t const len = strlen(token);
+	if (len + 2 > sizeof(text)) {
+		return true;
+	}
+
+	memcpy(text, token, len);
+	text[len] = '\n';
+	text[len + 1] = 0;
+	return parseNumber(text, number);
+}
+
+/*
+
+loads the pricing tiers, one per line in ascending order of cost: the cost that bounds the tier
+from above (inclusive) and the markup, '*' bounds the last tier, which takes the rest of the costs
+
+# max-cost  markup
+30000   0.50
+60000   0.40
+*       0.30
+
+*/
+void pricing (const char *path)
+{
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		pricingErr(path, 0, strerror(errno));
+	}
+
+	pricing_t tiers;
+	for (size_t i = 0; i != KINDS; ++i) {
+		tiers.threshold[i] = HUGE_VAL;
+		tiers.markup[i] = 0;
+	}
+	tiers.tiers = 0;
+	tiers.builtin = false;
+
+	char *line = NULL;
+	size_t n = 0;
+	size_t lineno = 0;
+	bool bounded = true;
+	const char *err = NULL;
+	while (!err && getline(&line, &n, file) != -1) {
+		++lineno;
+		char *hash = strchr(line, '#');
+		if (hash) {
+			*hash = 0;
+		}
+
+		char *save = NULL;
+		char *bound = strtok_r(line, " \t\r\n,", &save);
+		if (!bound) {
+			continue;
+		}
+
+		char *rate = strtok_r(NULL, " \t\r\n,", &save);
+		double threshold = HUGE_VAL;
+		double markup = 0;
+		if (!bounded) {
+			err = "the unbounded tier must be the last one";
+		} else if (tiers.tiers == KINDS) {
+			err = "too many tiers";
+		} else if (!rate || strtok_r(NULL, " \t\r\n,", &save)) {
+			err = "expects the max cost and the markup of the tier";
+		} else if (strcmp(bound, "*") && (pricingNumber(bound, &threshold) || threshold <= 0)) {
+			err = "invalid max cost";
+		} else if (tiers.tiers && threshold <= tiers.threshold[tiers.tiers - 1]) {
+			err = "the max costs must ascend";
+		} else if (pricingNumber(rate, &markup) || markup < 0) {
+			err = "invalid markup";
+		} else {
+			bounded = strcmp(bound, "*");
+			tiers.threshold[tiers.tiers] = (bounded)? threshold : HUGE_VAL;
+			tiers.markup[tiers.tiers] = markup;
+			++tiers.tiers;
+		}
+	}
+
+	free(line);
+	fclose(file);
+	if (err) {
+		pricingErr(path, lineno, err);
+	}
+
+	if (bounded) {
+		pricingErr(path, lineno, "the last tier must be unbounded (*)");
+	}
+
+	_pricing_ = tiers;
+}
+
+void head (void)
+{
+	printf("SHOE SALES INVENTORY PROGRAM\n");
+}
+
+void gcode (void)
+{
+	bool invalid = true;
+	ssize_t chars = 0;
+	size_t len = 0;
+	char *text = NULL;
+	const char prompt[] = "Input the shoe reference code:";
+	printf("%s", prompt);
+	do {
+		errno = 0;
+		chars = _in_->line(&text);
+		if (chars == -1) {
+
+			if (errno) {
+				fprintf(stderr, "gcode: %s\n", strerror(errno));
+				cleanup();
+				exit(EXIT_FAILURE);
+			}
+
+			printf("\nPlease input valid data\n");
+			printf("%s", prompt);
+
+		} else if (chars > MAX_STRING_LEN) {
+			invalid = true;
+			char msg[] = "The input exceeds the max number of chars %d\n";
+			printf(msg, MAX_STRING_LEN);
+			printf("%s", prompt);
+		} else {
+			len = trimWhiteSpace(&text, chars);
+			if (!len) {
+				invalid = true;
+				printf("Please input a valid reference code\n");
+				printf("%s", prompt);
+			} else {
+				invalid = false;
+			}
+		}
+
+	} while (chars == -1 || invalid);
+
+	// the view is gone with the next line, the trimmed text is kept
+	memcpy(*_code_, text, len);
+	(*_code_)[len] = 0;
+}
+
+void ginfo (void)
+{
+	bool invalid = true;
+	ssize_t chars = 0;
+	size_t len = 0;
+	char *text = NULL;
+	const char prompt[] = "Input the shoe description:";
+	printf("%s", prompt);
+	do {
+		errno = 0;
+		chars = _in_->line(&text);
+		if (chars == -1) {
+
+			if (errno) {
+				fprintf(stderr, "ginfo: %s\n", strerror(errno));
+				cleanup();
+				exit(EXIT_FAILURE);
+			}
+
+			printf("\nPlease input valid data\n");
+			printf("%s", prompt);
+
+		} else if (chars > MAX_STRING_LEN) {
+			invalid = true;
+			char msg[] = "The input exceeds max number of chars %d\n";
+			printf(msg, MAX_STRING_LEN);
+			printf("%s", prompt);
+		} else {
+			len = trimWhiteSpace(&text, chars);
+			if (!len) {
+				invalid = true;
+				printf("Please input a valid description\n");
+				printf("%s", prompt);
+			} else {
+				invalid = false;
+			}
+		}
+
+	} while (chars == -1 || invalid);
+
+	// the view is gone with the next line, the trimmed text is kept
+	memcpy(*_info_, text, len);
+	(*_info_)[len] = 0;
+}
+
+void gsize (void)
+{
+	char prompt[] = "Input the shoe size:";
+	validData("gsize", prompt);
 	_size_ = _number_ ;
 }
 
-void gavail (void)
+void gavail (void)
+{
+	char *text = NULL;
+	ssize_t chars = 0;
+	bool invalid = true;
+	char prompt[] = "Input N/Y if the shoe is (un)available for sale:";
+	printf("%s", prompt);
+	do {
+		errno = 0;
+		chars = _in_->line(&text);
+		if (chars == -1) {
+
+			if (errno) {
+				fprintf(stderr, "gavail: %s\n", strerror(errno));
+				cleanup();
+				exit(EXIT_FAILURE);
+			}
+
+			printf("\nPlease input N/Y\n");
+			printf("%s", prompt);
+
+		} else if (chars > MAX_STRING_LEN) {
+
+			invalid = true;
+			char msg[] = "The input exceeds the max number of chars %d\n";
+			printf(msg, MAX_STRING_LEN);
+			printf("Please input just N/Y\n");
+			printf("%s", prompt);
+
+		} else {
+
+			skipWhiteSpace(&text);
+			char const c = *text ;
+			if (c == 'y' || c == 'Y' || c == 'n' || c == 'N'){
+				invalid = false;
+			} else {
+				invalid = true;
+			}
+
+			if (invalid) {
+				printf("Please input N/Y\n");
+				printf("%s", prompt);
+			}
+		}
+
+	} while (chars == -1 || invalid);
+
+	_avail_ = *text;
+	if (_avail_ == 'y') {
+		_avail_ = 'Y';
+	}
+
+	if (_avail_ == 'n') {
+		_avail_ = 'N';
+	}
+}
+
+void gnew (void)
+{
+	char *text = NULL;
+	ssize_t chars = 0;
+	bool invalid = true;
+	char prompt[] = "Input N/Y if there is (no) other new shoe to add:";
+	printf("\n");
+	printf("%s", prompt);
+	do {
+		errno = 0;
+		chars = _in_->line(&text);
+		if (chars == -1) {
+
+			if (errno) {
+				fprintf(stderr, "gnew: %s\n", strerror(errno));
+				cleanup();
+				exit(EXIT_FAILURE);
+			}
+
+			printf("\nPlease input N/Y\n");
+			printf("%s", prompt);
+
+		} else if (chars > MAX_STRING_LEN) {
+
+			invalid = true;
+			char msg[] = "The input exceeds the max number of chars %d\n";
+			printf(msg, MAX_STRING_LEN);
+			printf("Please input just N/Y\n");
+			printf("%s", prompt);
+
+		} else {
+
+			skipWhiteSpace(&text);
+			char const c = *text ;
+			if (c == 'y' || c == 'Y' || c == 'n' || c == 'N'){
+				invalid = false;
+			} else {
+				invalid = true;
+			}
+
+			if (invalid) {
+				printf("Please input N/Y\n");
+				printf("%s", prompt);
+			}
+		}
+
+	} while (chars == -1 || invalid);
+
+	char const c = *text;
+	if (c == 'y' || c == 'Y') {
+		_new_ = true;
+	} else {
+		_new_ = false;
+	}
+
+	printf("\n");
+}
+
+void gcost (void)
+{
+	char prompt[] = "Input the shoe cost:";
+	char msg[] = "Please input a valid shoe cost value";
+	validData("gcost", prompt, callback, msg);
+	_cost_ = _number_ ;
+}
+
+// built-in tiers, the thresholds are constants that the compiler folds into the compares
+struct builtin_tiers
+{
+	static constexpr size_t tiers = 3;
+	static constexpr double threshold (size_t const i)
+	{
+		return (i == 0)? 30.0e3 : 60.0e3;
+	}
+};
+
+template <typename T>
+static inline size_t tierOf (double const cost)
+{
+	size_t tier = 0;
+	for (size_t i = 0; i != (T::tiers - 1); ++i) {
+		tier += (cost > T::threshold(i));
+	}
+
+	return tier;
+}
+
+// band of the item by its cost
+static kind_t band (double const cost)
+{
+	if (_pricing_.builtin) {
+		return ((kind_t) tierOf<builtin_tiers>(cost));
+	}
+
+	return ((kind_t) _tier_(&_pricing_, cost));
+}
+
+// profit per unit of cost of the band
+static double markup (kind_t const kind)
+{
+	return _pricing_.markup[kind];
+}
+
+void gprofit (void)
+{
+	_profit_ = markup(_kind_);
+}
+
+void gsale (void)
+{
+	double const cost = _cost_ ;
+	double const profit = _profit_ ;
+	double const sale = cost * (profit + 1.0);
+	_sale_ = sale;
+}
+
+void gcount (void)
+{
+	char prompt[] = "Input the shoe count:";
+	void (*cb) (bool*) = callback_cnt;
+	char msg[] = "Please input a valid shoe count value";
+	validData("gcount", prompt, cb, msg);
+	_count_ = _number_ ;
+}
+
+Item *gitem (void)
+{
+	char *code = Util_CopyString(*_code_);
+	if (!code) {
+		Util_Clear();
+		fprintf(stderr, "gitem: error\n");
+		exit(EXIT_FAILURE);
+	}
+
+	char *info = Util_CopyString(*_info_);
+	if (!info) {
+		Util_Clear();
+		fprintf(stderr, "gitem: error\n");
+		exit(EXIT_FAILURE);
+	}
+
+	memset(*_temp_, 0, MAX_BUFFER_SIZE);
+	**_temp_ = _avail_ ;
+	char *avail = Util_CopyString(*_temp_);
+	if (!avail) {
+		Util_Clear();
+		fprintf(stderr, "gitem: error\n");
+		exit(EXIT_FAILURE);
+	}
+
+	double *size = Util_CopyNumber(&_size_);
+	if (!size) {
+		Util_Clear();
+		fprintf(stderr, "gitem: error\n");
+		exit(EXIT_FAILURE);
+	}
+
+	double *cost = Util_CopyNumber(&_cost_);
+	if (!cost) {
+		Util_Clear();
+		fprintf(stderr, "gitem: error\n");
+		exit(EXIT_FAILURE);
+	}
+
+	double *sale = Util_CopyNumber(&_sale_);
+	if (!sale) {
+		Util_Clear();
+		fprintf(stderr, "gitem: error\n");
+		exit(EXIT_FAILURE);
+	}
+
+	double *count = Util_CopyNumber(&_count_);
+	if (!count) {
+		Util_Clear();
+		fprintf(stderr, "gitem: error\n");
+		exit(EXIT_FAILURE);
+	}
+
+	Kind *kind = new Kind(_kind_);
+	if (!kind) {
+		Util_Clear();
+		fprintf(stderr, "gitem: error\n");
+		exit(EXIT_FAILURE);
+	}
+
+	Item *item = new Item(code, info, avail, size, cost, sale, count, kind);
+	if (!item) {
+		Util_Clear();
+		fprintf(stderr, "gitem: error\n");
+		exit(EXIT_FAILURE);
+	}
+
+	return item;
+}
+
+size_t gput (ItemTable *table)
+{
+	if (_journal_) {
+		table->_lsn_ = _journal_->append(*_code_,
+						 *_info_,
+						 _avail_,
+						 _size_,
+						 _cost_,
+						 _sale_,
+						 _count_,
+						 _kind_);
+	}
+
+	if (_stream_) {
+		table->fold(_cost_, _sale_, _count_, _kind_, _avail_);
+		return NPOS;
+	}
+
+	size_t row = NPOS;
+	int const rc = table->upsert(*_code_,
+				     *_info_,
+				     _avail_,
+				     _size_,
+				     _cost_,
+				     _sale_,
+				     _count_,
+				     _kind_,
+				     &row);
+	if (rc != 0) {
+		fprintf(stderr, "gput: error\n");
+		cleanup();
+		exit(EXIT_FAILURE);
+	}
+
+	if (_journal_ && _snapshot_ && _journal_->bytes() > (_compact_ << 20)) {
+		compact(table);
+	}
+
+	return row;
+}
+
+// deletes the item, the deletion is journaled before it is applied as gput() does
+void erase (ItemTable *table, const char *code)
+{
+	size_t const row = table->find(code);
+	if (row == NPOS) {
+		printf("REFERENCE %s NOT FOUND\n", code);
+		return;
+	}
+
+	if (_journal_) {
+		table->_lsn_ = _journal_->append(code, "", 0, 0, 0, 0, 0, A, RECORD_ERASE);
+		_journal_->ack(table->_lsn_);
+	}
+
+	if (table->erase(row) != 0) {
+		fprintf(stderr, "erase: error\n");
+		cleanup();
+		exit(EXIT_FAILURE);
+	}
+}
+
+void gkind (void)
+{
+	_kind_ = band(_cost_);
+}
+
+void header (void)
+{
+	_out_->text("THE SHOE INPUT DATA IS THE FOLLOWING\n\n");
+}
+
+void code (void)
+{
+	_out_->field("REFERENCE", *_code_);
+}
+
+void info (void)
+{
+	_out_->field("DESCRIPTION", *_info_);
+}
+
+void size (void)
+{
+	_out_->field("SIZE", _size_, 1);
+}
+
+void avail (void)
+{
+	_out_->text("AVAILABLE: ").put(_avail_).put('\n');
+}
+
+void cost (void)
+{
+	_out_->field("COST", _cost_, 2);
+}
+
+void sale (void)
+{
+	_out_->field("SALE", _sale_, 2);
+}
+
+void count (void)
+{
+	_out_->field("COUNT", _count_, 0);
+}
+
+void kind (void)
+{
+	char const k = ('A' + _kind_);
+	_out_->text("KIND: ").put(k).put('\n');
+}
+
+void total (void)
+{
+	double const cost = _cost_ ;
+	double const sale = _sale_ ;
+	double const units = _count_ ;
+	double const total_cost = units * cost;
+	double const total_sale = units * sale;
+	_out_->field("TOTAL COST", total_cost, 2);
+	_out_->text("TOTAL PROFIT OF ").fixed(units, 0).field(" UNITS", total_sale, 2);
+}
+
+void profit (void)
+{
+	double const cost = _cost_ ;
+	double const sale = _sale_ ;
+	double const units = _count_ ;
+	double const profit = (sale - cost);
+	double const total_cost = units * cost;
+	double const net_profit = units * (sale - cost);
+	_out_->field("PROFIT PER UNIT", profit, 2);
+	_out_->field("NET PROFIT", net_profit, 2);
+	_out_->field("PROFIT PERCENTAGE", percentage(net_profit, total_cost), 2);
+}
+
+/*
+
+Aggregation Kernels
+
+The kernels reduce the net profit, sum of units * (sale - cost), and the expenses, sum of
+units * cost, over the columns of the item store. The vector kernels accumulate in lanes and
+add the lanes at the end so the order of the summation differs from the scalar loop, and the
+AVX2 and AVX-512 kernels fuse the multiply-add. For n items with non-negative expenses the
+variants agree within a relative error of n * DBL_EPSILON of the sum of the magnitudes of the
+terms (the usual bound for recursive summation), which is far below the cent resolution of the
+report for any realistic inventory.
+
+aggregate() applies the kernel to fixed chunks of AGG_CHUNK items and merges the partial sums
+of the chunks pairwise in the order of the chunks. The chunks are spread over the threads but
+neither their bounds nor the merge order depend on the number of threads, so the totals are
+bit-identical for any thread count, and the error bound drops to (AGG_CHUNK + log2(n / AGG_CHUNK))
+* DBL_EPSILON instead of growing with n.
+
+*/
+
+static void agg_scalar (const double *count,
+			const double *sale,
+			const double *cost,
+			size_t const numel,
+			double *profit,
+			double *expenses)
+{
+	double p = 0;
+	double e = 0;
+	for (size_t i = 0; i != numel; ++i) {
+		double const units = count[i];
+		p += units * (sale[i] - cost[i]);
+		e += units * cost[i];
+	}
+
+	*profit = p;
+	*expenses = e;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static void agg_sse2 (const double *count,
+		      const double *sale,
+		      const double *cost,
+		      size_t const numel,
+		      double *profit,
+		      double *expenses)
+{
+	__m128d p0 = _mm_setzero_pd();
+	__m128d p1 = _mm_setzero_pd();
+	__m128d e0 = _mm_setzero_pd();
+	__m128d e1 = _mm_setzero_pd();
+	size_t i = 0;
+	for (; (i + 4) <= numel; i += 4) {
+		__m128d const u0 = _mm_loadu_pd(count + i);
+		__m128d const u1 = _mm_loadu_pd(count + i + 2);
+		__m128d const c0 = _mm_loadu_pd(cost + i);
+		__m128d const c1 = _mm_loadu_pd(cost + i + 2);
+		__m128d const s0 = _mm_loadu_pd(sale + i);
+		__m128d const s1 = _mm_loadu_pd(sale + i + 2);
+		p0 = _mm_add_pd(p0, _mm_mul_pd(u0, _mm_sub_pd(s0, c0)));
+		p1 = _mm_add_pd(p1, _mm_mul_pd(u1, _mm_sub_pd(s1, c1)));
+		e0 = _mm_add_pd(e0, _mm_mul_pd(u0, c0));
+		e1 = _mm_add_pd(e1, _mm_mul_pd(u1, c1));
+	}
+
+	double lanes[2];
+	_mm_storeu_pd(lanes, _mm_add_pd(p0, p1));
+	double p = lanes[0] + lanes[1];
+	_mm_storeu_pd(lanes, _mm_add_pd(e0, e1));
+	double e = lanes[0] + lanes[1];
+	for (; i != numel; ++i) {
+		double const units = count[i];
+		p += units * (sale[i] - cost[i]);
+		e += units * cost[i];
+	}
+
+	*profit = p;
+	*expenses = e;
+}
+
+__attribute__((target("avx2,fma")))
+static void agg_avx2 (const double *count,
+		      const double *sale,
+		      const double *cost,
+		      size_t const numel,
+		      double *profit,
+		      double *expenses)
+{
+	__m256d p0 = _mm256_setzero_pd();
+	__m256d p1 = _mm256_setzero_pd();
+	__m256d e0 = _mm256_setzero_pd();
+	__m256d e1 = _mm256_setzero_pd();
+	size_t i = 0;
+	for (; (i + 8) <= numel; i += 8) {
+		__m256d const u0 = _mm256_loadu_pd(count + i);
+		__m256d const u1 = _mm256_loadu_pd(count + i + 4);
+		__m256d const c0 = _mm256_loadu_pd(cost + i);
+		__m256d const c1 = _mm256_loadu_pd(cost + i + 4);
+		__m256d const s0 = _mm256_loadu_pd(sale + i);
+		__m256d const s1 = _mm256_loadu_pd(sale + i + 4);
+		p0 = _mm256_fmadd_pd(u0, _mm256_sub_pd(s0, c0), p0);
+		p1 = _mm256_fmadd_pd(u1, _mm256_sub_pd(s1, c1), p1);
+		e0 = _mm256_fmadd_pd(u0, c0, e0);
+		e1 = _mm256_fmadd_pd(u1, c1, e1);
+	}
+
+	double lanes[4];
+	_mm256_storeu_pd(lanes, _mm256_add_pd(p0, p1));
+	double p = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	_mm256_storeu_pd(lanes, _mm256_add_pd(e0, e1));
+	double e = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	for (; i != numel; ++i) {
+		double const units = count[i];
+		p += units * (sale[i] - cost[i]);
+		e += units * cost[i];
+	}
+
+	*profit = p;
+	*expenses = e;
+}
+
+__attribute__((target("avx512f")))
+static void agg_avx512 (const double *count,
+			const double *sale,
+			const double *cost,
+			size_t const numel,
+			double *profit,
+			double *expenses)
+{
+	__m512d p0 = _mm512_setzero_pd();
+	__m512d e0 = _mm512_setzero_pd();
+	size_t i = 0;
+	for (; (i + 8) <= numel; i += 8) {
+		__m512d const u = _mm512_loadu_pd(count + i);
+		__m512d const c = _mm512_loadu_pd(cost + i);
+		__m512d const s = _mm512_loadu_pd(sale + i);
+		p0 = _mm512_fmadd_pd(u, _mm512_sub_pd(s, c), p0);
+		e0 = _mm512_fmadd_pd(u, c, e0);
+	}
+
+	if (i != numel) {
+		// masked loads fill the lanes past the end with zeros which add nothing
+		__mmask8 const mask = (__mmask8) ((1u << (numel - i)) - 1u);
+		__m512d const u = _mm512_maskz_loadu_pd(mask, count + i);
+		__m512d const c = _mm512_maskz_loadu_pd(mask, cost + i);
+		__m512d const s = _mm512_maskz_loadu_pd(mask, sale + i);
+		p0 = _mm512_fmadd_pd(u, _mm512_sub_pd(s, c), p0);
+		e0 = _mm512_fmadd_pd(u, c, e0);
+	}
+
+	double lanes[8];
+	_mm512_storeu_pd(lanes, p0);
+	double const p = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) +
+			 ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+	_mm512_storeu_pd(lanes, e0);
+	double const e = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) +
+			 ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+
+	*profit = p;
+	*expenses = e;
+}
+
+// true if the OS saves the register state selected by the mask on context switches
+static bool xsaves (unsigned const mask)
+{
+	unsigned eax = 0;
+	unsigned edx = 0;
+	__asm__ ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((eax & mask) == mask);
+}
+#endif
+
+// counts the thresholds under the cost, the sorted thresholds make the mask a run of low bits
+static size_t tier_scalar (const pricing_t *pricing, double const cost)
+{
+	size_t tier = 0;
+	for (size_t i = 0; i != KINDS; ++i) {
+		tier += (cost > pricing->threshold[i]);
+	}
+
+	return tier;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static size_t tier_sse2 (const pricing_t *pricing, double const cost)
+{
+	__m128d const c = _mm_set1_pd(cost);
+	unsigned mask = 0;
+	for (size_t i = 0; i != KINDS; i += 2) {
+		__m128d const t = _mm_loadu_pd(&pricing->threshold[i]);
+		mask |= ((unsigned) _mm_movemask_pd(_mm_cmpgt_pd(c, t))) << i;
+	}
+
+	return __builtin_ctz(~mask);
+}
+
+__attribute__((target("avx2")))
+static size_t tier_avx2 (const pricing_t *pricing, double const cost)
+{
+	__m256d const c = _mm256_set1_pd(cost);
+	unsigned mask = 0;
+	for (size_t i = 0; i != KINDS; i += 4) {
+		__m256d const t = _mm256_loadu_pd(&pricing->threshold[i]);
+		mask |= ((unsigned) _mm256_movemask_pd(_mm256_cmp_pd(c, t, _CMP_GT_OQ))) << i;
+	}
+
+	return __builtin_ctz(~mask);
+}
+#endif
+
+// reprices the items with costs in [lo, hi], factor[k] is (1 + markup) of the tier k
+static size_t reprice_scalar (const pricing_t *pricing,
+			      const double *factor,
+			      double const lo,
+			      double const hi,
+			      const double *cost,
+			      double *sale,
+			      Kind *kind,
+			      size_t const numel)
+{
+	size_t repriced = 0;
+	for (size_t i = 0; i != numel; ++i) {
+		double const c = cost[i];
+		if (c < lo || c > hi) {
+			continue;
+		}
+
+		size_t const k = tier_scalar(pricing, c);
+		kind[i].kind = (kind_t) k;
+		sale[i] = c * factor[k];
+		++repriced;
+	}
+
+	return repriced;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static_assert(sizeof(Kind) == sizeof(int32_t), "reprice_avx2 stores the kinds as 32-bit integers");
+
+// counts the thresholds under four costs at once and gathers their factors, masked stores skip
+// the costs out of the range
+__attribute__((target("avx2")))
+static size_t reprice_avx2 (const pricing_t *pricing,
+			    const double *factor,
+			    double const lo,
+			    double const hi,
+			    const double *cost,
+			    double *sale,
+			    Kind *kind,
+			    size_t const numel)
+{
+	size_t const bounds = (pricing->tiers)? (pricing->tiers - 1) : 0;
+	__m256d thresholds[KINDS];
+	for (size_t t = 0; t != bounds; ++t) {
+		thresholds[t] = _mm256_set1_pd(pricing->threshold[t]);
+	}
+
+	__m256d const vlo = _mm256_set1_pd(lo);
+	__m256d const vhi = _mm256_set1_pd(hi);
+	__m256i const pack = _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0);
+	size_t repriced = 0;
+	size_t i = 0;
+	for (; i + 4 <= numel; i += 4) {
+		__m256d const c = _mm256_loadu_pd(cost + i);
+		__m256i tier = _mm256_setzero_si256();
+		for (size_t t = 0; t != bounds; ++t) {
+			__m256d const above = _mm256_cmp_pd(c, thresholds[t], _CMP_GT_OQ);
+			tier = _mm256_sub_epi64(tier, _mm256_castpd_si256(above));
+		}
+
+		__m256d const in = _mm256_and_pd(_mm256_cmp_pd(c, vlo, _CMP_GE_OQ),
+						 _mm256_cmp_pd(c, vhi, _CMP_LE_OQ));
+		__m256i const mask = _mm256_castpd_si256(in);
+		__m256d const f = _mm256_i64gather_pd(factor, tier, 8);
+		_mm256_maskstore_pd(sale + i, mask, _mm256_mul_pd(c, f));
+		__m128i const tier32 = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(tier, pack));
+		__m128i const mask32 = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(mask, pack));
+		_mm_maskstore_epi32((int*) (kind + i), mask32, tier32);
+		repriced += __builtin_popcount(_mm256_movemask_pd(in));
+	}
+
+	return repriced + reprice_scalar(pricing, factor, lo, hi, cost + i, sale + i, kind + i, numel - i);
+}
+#endif
+
+void dispatch (void)
+{
+	_aggregate_ = agg_scalar;
+	_tier_ = tier_scalar;
+	_reprice_ = reprice_scalar;
+	_simd_ = "scalar";
+	_kernels_numel_ = 0;
+	_kernels_[_kernels_numel_].name = "scalar";
+	_kernels_[_kernels_numel_++].kernel = agg_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned eax = 0;
+	unsigned ebx = 0;
+	unsigned ecx = 0;
+	unsigned edx = 0;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+		return;
+	}
+
+	if (edx & bit_SSE2) {
+		_aggregate_ = agg_sse2;
+		_tier_ = tier_sse2;
+		_simd_ = "sse2";
+		_kernels_[_kernels_numel_].name = "sse2";
+		_kernels_[_kernels_numel_++].kernel = agg_sse2;
+	}
+
+	bool const osxsave = (ecx & bit_OSXSAVE);
+	bool const fma = (ecx & bit_FMA);
+	// XMM and YMM state (XCR0 bits 1 and 2)
+	if (!osxsave || !xsaves(0x06)) {
+		return;
+	}
+
+	if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+		return;
+	}
+
+	if (ebx & bit_AVX2) {
+		_tier_ = tier_avx2;
+		_reprice_ = reprice_avx2;
+	}
+
+	if ((ebx & bit_AVX2) && fma) {
+		_aggregate_ = agg_avx2;
+		_simd_ = "avx2";
+		_kernels_[_kernels_numel_].name = "avx2";
+		_kernels_[_kernels_numel_++].kernel = agg_avx2;
+	}
+
+	// opmask and ZMM state (XCR0 bits 5, 6 and 7)
+	if ((ebx & bit_AVX512F) && xsaves(0xe6)) {
+		_aggregate_ = agg_avx512;
+		_simd_ = "avx512";
+		_kernels_[_kernels_numel_].name = "avx512";
+		_kernels_[_kernels_numel_++].kernel = agg_avx512;
+	}
+#endif
+}
+
+// number of threads of the parallel stages, one per core unless --threads says otherwise
+static unsigned workers (void)
+{
+	unsigned threads = _threads_;
+	if (!threads) {
+		threads = std::thread::hardware_concurrency();
+	}
+
+	if (!threads) {
+		threads = 1;
+	}
+
+	return threads;
+}
+
+// sums the partials in a balanced tree whose shape depends only on their number
+static double pairwise (const double *x, size_t const numel)
+{
+	if (numel == 1) {
+		return x[0];
+	}
+
+	size_t const half = (numel / 2);
+	return (pairwise(x, half) + pairwise(x + half, numel - half));
+}
+
+// reduces the chunks that the thread claims, the partials are stored by chunk
+static void aggChunks (const ItemTable *table,
+		       size_t const chunks,
+		       std::atomic<size_t> *next,
+		       double *profits,
+		       double *expenses)
+{
+	const double *count = table->_count_.begin();
+	const double *sale = table->_sale_.begin();
+	const double *cost = table->_cost_.begin();
+	size_t const numel = table->numel();
+	size_t chunk = next->fetch_add(1);
+	while (chunk < chunks) {
+		size_t const first = chunk * AGG_CHUNK;
+		size_t const last = (first + AGG_CHUNK < numel)? first + AGG_CHUNK : numel;
+		_aggregate_(count + first,
+			    sale + first,
+			    cost + first,
+			    last - first,
+			    &profits[chunk],
+			    &expenses[chunk]);
+		chunk = next->fetch_add(1);
+	}
+}
+
+// reduces the columns in parallel, a check of the running totals
+static void scan (ItemTable *table, double *total_profit, double *total_expenses)
+{
+	double profit = 0;
+	double expenses = 0;
+	size_t const numel = table->numel();
+	size_t const chunks = (numel + (AGG_CHUNK - 1)) / AGG_CHUNK;
+	if (chunks) {
+		double *partials = (double*) Util_Malloc(2 * chunks * sizeof(double));
+		if (!partials) {
+			fprintf(stderr, "scan: %s\n", strerror(errno));
+			cleanup();
+			exit(EXIT_FAILURE);
+		}
+
+		unsigned threads = workers();
+		if (threads > chunks) {
+			threads = chunks;
+		}
+
+		// the calling thread takes its share of the chunks as well
+		std::atomic<size_t> next(0);
+		std::thread *workers = NULL;
+		if (threads > 1) {
+			workers = (std::thread*) Util_Malloc((threads - 1) * sizeof(std::thread));
+			if (!workers) {
+				fprintf(stderr, "scan: %s\n", strerror(errno));
+				cleanup();
+				exit(EXIT_FAILURE);
+			}
+		}
+
+		for (unsigned i = 1; i < threads; ++i) {
+			::new ((void*) &workers[i - 1]) std::thread(aggChunks,
+								     table,
+								     chunks,
+								     &next,
+								     partials,
+								     partials + chunks);
+		}
+
+		aggChunks(table, chunks, &next, partials, partials + chunks);
+		for (unsigned i = 1; i < threads; ++i) {
+			workers[i - 1].join();
+			workers[i - 1].~thread();
+		}
+
+		profit = pairwise(partials, chunks);
+		expenses = pairwise(partials + chunks, chunks);
+		if (workers) {
+			workers = (std::thread*) Util_Free(workers);
+		}
+		partials = (double*) Util_Free(partials);
+	}
+
+	*total_profit = profit;
+	*total_expenses = expenses;
+}
+
+// reports the running totals, which --verify checks against a scan of the columns
+void aggregate (ItemTable *table)
+{
+	double profit = 0;
+	double expenses = 0;
+	double units = 0;
+	table->totals(&profit, &expenses, &units);
+	// the folded items are gone, there is nothing to scan them against
+	if (_verify_ && !table->_folded_) {
+		double scan_profit = 0;
+		double scan_expenses = 0;
+		scan(table, &scan_profit, &scan_expenses);
+		if (fabs(profit - scan_profit) > 0.005 || fabs(expenses - scan_expenses) > 0.005) {
+			fprintf(stderr, "aggregate: the running totals differ from the scan\n");
+			profit = scan_profit;
+			expenses = scan_expenses;
+		}
+	}
+
+	printf("AGGREGATE PROFIT: %.2f\n", profit);
+	printf("AGGREGATE COST: %.2f\n", expenses);
+	printf("PROFIT PERCENTAGE: %.2f\n", percentage(profit, expenses));
+}
+
+// reprices the chunks that the thread claims, then sums the contribution of their rows by kind
+static void repriceChunks (ItemTable *table,
+			   const pricing_t *pricing,
+			   double const lo,
+			   double const hi,
+			   const double *factor,
+			   size_t const chunks,
+			   std::atomic<size_t> *next,
+			   double *partials,
+			   size_t *repriced)
+{
+	const double *cost = table->_cost_.begin();
+	const double *count = table->_count_.begin();
+	double *sale = table->_sale_.begin();
+	Kind *kind = table->_kind_.begin();
+	size_t const numel = table->numel();
+	size_t chunk = next->fetch_add(1);
+	while (chunk < chunks) {
+		size_t const first = chunk * AGG_CHUNK;
+		size_t const last = (first + AGG_CHUNK < numel)? first + AGG_CHUNK : numel;
+		repriced[chunk] = _reprice_(pricing,
+					    factor,
+					    lo,
+					    hi,
+					    cost + first,
+					    sale + first,
+					    kind + first,
+					    last - first);
+
+		double *sums = &partials[3 * KINDS * chunk];
+		for (size_t i = first; i != last; ++i) {
+			if ((size_t) kind[i].kind >= KINDS) {
+				// the caller reports it once the threads are done
+				repriced[chunk] = NPOS;
+				break;
+			}
+
+			double *s = &sums[3 * kind[i].kind];
+			double const units = count[i];
+			s[0] += units * (sale[i] - cost[i]);
+			s[1] += units * cost[i];
+			s[2] += units;
+		}
+		chunk = next->fetch_add(1);
+	}
+}
+
+/*
+
+reclassifies the items with costs in [lo, hi] with the pricing and sets their sale to cost *
+(1 + markup) in one pass over the columns, split in chunks among the threads. The running totals
+are rebuilt from the partial sums of the chunks, merged in the order of the chunks, and replace
+the old ones once every chunk is done. The sale and profit indexes are rebuilt the next time that
+the table needs them. Returns the number of items repriced.
+
+*/
+static size_t repriceRows (ItemTable *table, const pricing_t *pricing, double const lo, double const hi)
+{
+	size_t const numel = table->numel();
+	size_t const chunks = (numel + (AGG_CHUNK - 1)) / AGG_CHUNK;
+	size_t total = 0;
+	if (chunks) {
+		double factor[KINDS];
+		for (size_t k = 0; k != KINDS; ++k) {
+			factor[k] = (pricing->markup[k] + 1.0);
+		}
+
+		double *partials = (double*) Util_Malloc(3 * KINDS * chunks * sizeof(double));
+		size_t *repriced = (size_t*) Util_Malloc(chunks * sizeof(size_t));
+		if (!partials || !repriced) {
+			fprintf(stderr, "reprice: %s\n", strerror(errno));
+			cleanup();
+			exit(EXIT_FAILURE);
+		}
+		memset(partials, 0, 3 * KINDS * chunks * sizeof(double));
+
+		unsigned threads = workers();
+		if (threads > chunks) {
+			threads = chunks;
+		}
+
+		// the calling thread takes its share of the chunks as well
+		std::atomic<size_t> next(0);
+		std::thread *workers = NULL;
+		if (threads > 1) {
+			workers = (std::thread*) Util_Malloc((threads - 1) * sizeof(std::thread));
+			if (!workers) {
+				fprintf(stderr, "reprice: %s\n", strerror(errno));
+				cleanup();
+				exit(EXIT_FAILURE);
+			}
+		}
+
+		for (unsigned i = 1; i < threads; ++i) {
+			::new ((void*) &workers[i - 1]) std::thread(repriceChunks,
+								     table,
+								     pricing,
+								     lo,
+								     hi,
+								     factor,
+								     chunks,
+								     &next,
+								     partials,
+								     repriced);
+		}
+
+		repriceChunks(table, pricing, lo, hi, factor, chunks, &next, partials, repriced);
+		for (unsigned i = 1; i < threads; ++i) {
+			workers[i - 1].join();
+			workers[i - 1].~thread();
+		}
+		workers = (std::thread*) Util_Free(workers);
+
+		totals_t totals[KINDS];
+		memset(totals, 0, sizeof(totals));
+		for (size_t c = 0; c != chunks; ++c) {
+			if (repriced[c] == NPOS) {
+				kindErr("reprice");
+			}
+
+			const double *sums = &partials[3 * KINDS * c];
+			for (size_t k = 0; k != KINDS; ++k) {
+				ksum(&totals[k].profit, sums[3 * k + 0]);
+				ksum(&totals[k].expenses, sums[3 * k + 1]);
+				ksum(&totals[k].units, sums[3 * k + 2]);
+			}
+			total += repriced[c];
+		}
+
+		memcpy(table->_totals_, totals, sizeof(totals));
+		partials = (double*) Util_Free(partials);
+		repriced = (size_t*) Util_Free(repriced);
+	}
+
+	if (table->_indexed_) {
+		table->_by_sale_.clear();
+		table->_by_profit_.clear();
+		table->_priced_ = false;
+	}
+
+	return total;
+}
+
+// reprices with the pricing in effect, the journal logs the repricing before it is applied
+void reprice (ItemTable *table, double const lo, double const hi)
+{
+	if (_journal_) {
+		table->_lsn_ = _journal_->reprice(&_pricing_, lo, hi);
+		_journal_->ack(table->_lsn_);
+	}
+
+	printf("REPRICED ITEMS: %zu\n", repriceRows(table, &_pricing_, lo, hi));
+}
+
+void lookup (ItemTable *table, const char *code)
+{
+	size_t const i = table->find(code);
+	if (i == NPOS) {
+		_out_->text("REFERENCE ").text(code).text(" NOT FOUND\n");
+		flush();
+		return;
+	}
+
+	Item item = table->row(i);
+	item.log();
+	item.total();
+	item.profit();
+	flush();
+}
+
+void range (ItemTable *table, double const lo, double const hi)
+{
+	_out_->text("\nITEMS COSTING ").fixed(lo, 2).text(" TO ").fixed(hi, 2).put('\n');
+	const OrderedIndex *index = &table->_by_cost_;
+	for (cursor_t it = index->lower(lo); it.leaf; index->next(&it)) {
+		if (it.leaf->keys[it.pos] > hi) {
+			break;
+		}
+
+		Item item = table->row(it.leaf->rows[it.pos]);
+		_out_->put('\n');
+		item.log();
+	}
+	flush();
+}
+
+void top (ItemTable *table, size_t const k)
+{
+	_out_->text("\nTOP ").fixed(k, 0).text(" ITEMS BY PROFIT PER UNIT\n");
+	const OrderedIndex *index = &table->_by_profit_;
+	size_t n = 0;
+	for (cursor_t it = index->last(); it.leaf && n != k; index->prev(&it), ++n) {
+		Item item = table->row(it.leaf->rows[it.pos]);
+		_out_->put('\n');
+		item.log();
+		item.profit();
+	}
+	flush();
+}
+
+static void groupMerge (group_t *dst, const group_t *src)
+{
+	if (!src->items) {
+		return;
+	}
+
+	if (!dst->items || src->min_cost < dst->min_cost) {
+		dst->min_cost = src->min_cost;
+	}
+
+	if (!dst->items || src->max_cost > dst->max_cost) {
+		dst->max_cost = src->max_cost;
+	}
+
+	dst->items += src->items;
+	dst->units += src->units;
+	dst->cost += src->cost;
+	dst->sale += src->sale;
+	dst->sum_cost += src->sum_cost;
+	for (size_t b = 0; b != HIST_BUCKETS; ++b) {
+		dst->hist[b] += src->hist[b];
+	}
+}
+
+static void groupLog (const group_t *grp, const char *kind, char const avail)
+{
+	_out_->text("\nGROUP: ").text(kind);
+	if (avail) {
+		_out_->text(" AVAILABLE ").put(avail);
+	}
+
+	_out_->put('\n');
+	_out_->field("ITEMS", grp->items, 0);
+	_out_->field("UNITS", grp->units, 0);
+	_out_->field("TOTAL COST", grp->cost, 2);
+	_out_->field("TOTAL SALE", grp->sale, 2);
+	_out_->field("NET PROFIT", grp->sale - grp->cost, 2);
+	_out_->field("MIN COST", grp->min_cost, 2);
+	_out_->field("MAX COST", grp->max_cost, 2);
+	_out_->field("MEAN COST", grp->sum_cost / grp->items, 2);
+	_out_->text("COST HISTOGRAM:\n");
+	for (size_t b = 0; b != HIST_BUCKETS; ++b) {
+		_out_->text("  ").fixed(b * HIST_WIDTH, 2);
+		if (b + 1 != HIST_BUCKETS) {
+			_out_->text(" TO ").fixed((b + 1) * HIST_WIDTH, 2);
+		} else {
+			_out_->text(" AND OVER");
+		}
+		_out_->field("", grp->hist[b], 0);
+	}
+}
+
+// gathers the statistics of every group (kind and availability) in a single scan of the columns
+void group (ItemTable *table, bool const avail)
+{
+	group_t groups[2 * KINDS];
+	memcpy(groups, table->_groups_, sizeof(groups));
+	const double *costs = table->_cost_.begin();
+	const double *sales = table->_sale_.begin();
+	const double *counts = table->_count_.begin();
+	const Kind *kinds = table->_kind_.begin();
+	const char *avails = table->_avail_.begin();
+	size_t const numel = table->numel();
+	for (size_t i = 0; i != numel; ++i) {
+		groupAdd(groups, costs[i], sales[i], counts[i], kinds[i].kind, avails[i]);
+	}
+
+	_out_->text("\nITEMS GROUPED BY KIND");
+	_out_->text((avail)? " AND AVAILABILITY\n" : "\n");
+	char const flags[] = {'N', 'Y'};
+	for (int k = 0; k != KINDS; ++k) {
+		Kind kind((kind_t) k);
+		const char *name = kind.stringify(&kind);
+		if (!avail) {
+			group_t merged;
+			memset(&merged, 0, sizeof(merged));
+			groupMerge(&merged, &groups[2 * k]);
+			groupMerge(&merged, &groups[2 * k + 1]);
+			if (merged.items) {
+				groupLog(&merged, name, 0);
+			}
+			continue;
+		}
+
+		for (int a = 0; a != 2; ++a) {
+			if (groups[2 * k + a].items) {
+				groupLog(&groups[2 * k + a], name, flags[a]);
+			}
+		}
+	}
+	flush();
+}
+
+void report (ItemTable *table)
+{
+	if ((_find_ || _range_ || _top_) && table->index() != 0) {
+		fprintf(stderr, "report: error\n");
+		cleanup();
+		exit(EXIT_FAILURE);
+	}
+
+	if (_find_) {
+		lookup(table, _find_);
+	}
+
+	if (_range_) {
+		range(table, _range_lo_, _range_hi_);
+	}
+
+	if (_top_) {
+		top(table, _top_);
+	}
+
+	if (_group_) {
+		group(table, (_group_ == 2));
+	}
+}
+
+// writes out the reports, the caller flushes before printing anything else to stdout
+void flush (void)
+{
+	if (_out_->flush() != 0) {
+		fprintf(stderr, "flush: %s\n", strerror(_out_->_error_));
+		cleanup();
+		exit(EXIT_FAILURE);
+	}
+}
+
+void greet (void)
+{
+	printf("\nThank you for providing the information\n");
+}
+
+void cleanup (void)
+{
+	if (_out_) {
+		Writer *out = _out_;
+		_out_ = NULL;
+		out->flush();
+	}
+
+	// stops the committer before the buffers of the journal are released
+	if (_journal_) {
+		_journal_->close();
+		_journal_ = NULL;
+	}
+
+	if (_mem_report_) {
+		Util_Dump(STDERR_FILENO, false);
+	}
+
+	if (_stats_) {
+		Util_StatsFile(_stats_);
+	}
+
+	Util_Clear();
+	if (_locale_ != (locale_t) 0) {
+		freelocale(_locale_);
+		_locale_ = (locale_t) 0;
+	}
+
+	if (_map_) {
+		munmap(_map_, _map_size_);
+		_map_ = NULL;
+		_map_size_ = 0;
+	}
+
+	if (_bench_csv_[0]) {
+		unlink(_bench_csv_);
+		_bench_csv_[0] = '\0';
+	}
+
+	if (_bench_snap_[0]) {
+		unlink(_bench_snap_);
+		_bench_snap_[0] = '\0';
+	}
+}
+
+#if defined(__unix__) || defined(__linux__) || defined(__APPLE__)
+void clear ()
+{
+        system("clear");
+}
+#elif defined(_WIN32) || defined(_WIN64)
+void clear ()
+{
+        system("cls");
+}
+#else
+void clear ()
+{
+	return;
+}
+#endif
+
+#if defined(__unix__) || defined(__linux__) || defined(__APPLE__)
+void hold ()
+{
+        return;
+}
+#elif defined(_WIN32) || defined(_WIN64)
+void hold ()
+{
+        system("pause");
+}
+#else
+void hold ()
+{
+	return;
+}
+#endif
+
+void get (void)
+{
+	gcode();
+	ginfo();
+	gsize();
+	gavail();
+	gcost();
+	gkind();
+	gprofit();
+	gsale();
+	gcount();
+}
+
+void gprice (void)
+{
+	gkind();
+	gprofit();
+	gsale();
+}
+
+void log (void)
+{
+	header();
+	code();
+	info();
+	size();
+	avail();
+	cost();
+	kind();
+	sale();
+	count();
+	total();
+	profit();
+	flush();
+	greet();
+}
+
+// parses the count of the option, only digits and a value in [1, max] are accepted
+static unsigned long long argCount (const char *opt, const char *arg, unsigned long long const max)
+{
+	char *end = NULL;
+	unsigned long long n = 0;
+	errno = 0;
+	if (*arg >= '0' && *arg <= '9') {
+		n = strtoull(arg, &end, 10);
+	}
+
+	if (!n || *end || errno == ERANGE || n > max) {
+		fprintf(stderr, "args: expects %s n with n > 0\n", opt);
+		exit(EXIT_FAILURE);
+	}
+
+	return n;
+}
+
+// parses the number of the option, only digits are accepted and zero is a valid value
+static unsigned long long argNumber (const char *opt, const char *arg)
+{
+	char *end = NULL;
+	unsigned long long n = 0;
+	errno = 0;
+	if (*arg >= '0' && *arg <= '9') {
+		n = strtoull(arg, &end, 10);
+	}
+
+	if (!end || *end || errno == ERANGE) {
+		fprintf(stderr, "args: expects %s n with n >= 0\n", opt);
+		exit(EXIT_FAILURE);
+	}
+
+	return n;
+}
+
+void args (int argc, char **argv)
+{
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--import") && (i + 1) < argc) {
+			_import_ = argv[++i];
+		} else if (!strcmp(argv[i], "--find") && (i + 1) < argc) {
+			_find_ = argv[++i];
+		} else if (!strcmp(argv[i], "--delete") && (i + 1) < argc) {
+			_delete_ = argv[++i];
+		} else if (!strcmp(argv[i], "--cost-range") && (i + 1) < argc) {
+			char *end = NULL;
+			const char *arg = argv[++i];
+			_range_lo_ = strtod(arg, &end);
+			if (*end != ':') {
+				fprintf(stderr, "args: expects --cost-range LO:HI\n");
+				exit(EXIT_FAILURE);
+			}
+			_range_hi_ = strtod(end + 1, &end);
+			if (*end) {
+				fprintf(stderr, "args: expects --cost-range LO:HI\n");
+				exit(EXIT_FAILURE);
+			}
+			_range_ = true;
+		} else if (!strcmp(argv[i], "--reprice") && (i + 1) < argc) {
+			char *end = NULL;
+			const char *arg = argv[++i];
+			_repricing_ = true;
+			if (strcmp(arg, "all")) {
+				_reprice_lo_ = strtod(arg, &end);
+				if (*end != ':') {
+					fprintf(stderr, "args: expects --reprice all or --reprice LO:HI\n");
+					exit(EXIT_FAILURE);
+				}
+				_reprice_hi_ = strtod(end + 1, &end);
+				// NaN bounds fail the comparison as well, they would reprice nothing
+				if (*end || !(_reprice_lo_ <= _reprice_hi_)) {
+					fprintf(stderr, "args: expects --reprice all or --reprice LO:HI\n");
+					exit(EXIT_FAILURE);
+				}
+			}
+		} else if (!strcmp(argv[i], "--top-profit") && (i + 1) < argc) {
+			_top_ = argCount("--top-profit", argv[++i], SIZE_MAX);
+		} else if (!strcmp(argv[i], "--group-by") && (i + 1) < argc) {
+			const char *arg = argv[++i];
+			if (!strcmp(arg, "kind")) {
+				_group_ = 1;
+			} else if (!strcmp(arg, "kind,avail")) {
+				_group_ = 2;
+			} else {
+				fprintf(stderr, "args: expects --group-by kind or --group-by kind,avail\n");
+				exit(EXIT_FAILURE);
+			}
+		} else if (!strcmp(argv[i], "--export") && (i + 1) < argc) {
+			_export_ = argv[++i];
+		} else if (!strcmp(argv[i], "--snapshot") && (i + 1) < argc) {
+			_snapshot_ = argv[++i];
+		} else if (!strcmp(argv[i], "--verify")) {
+			_verify_ = true;
+		} else if (!strcmp(argv[i], "--journal") && (i + 1) < argc) {
+			_journal_path_ = argv[++i];
+		} else if (!strcmp(argv[i], "--commit-window") && (i + 1) < argc) {
+			_window_ = argCount("--commit-window", argv[++i], LONG_MAX);
+		} else if (!strcmp(argv[i], "--compact") && (i + 1) < argc) {
+			// the size is compared in bytes, MiB << 20 must not overflow
+			_compact_ = argCount("--compact", argv[++i], SIZE_MAX >> 20);
+		} else if (!strcmp(argv[i], "--pricing") && (i + 1) < argc) {
+			_pricing_path_ = argv[++i];
+		} else if (!strcmp(argv[i], "--diff") && (i + 2) < argc) {
+			_diff_from_ = argv[++i];
+			_diff_to_ = argv[++i];
+		} else if (!strcmp(argv[i], "--bench")) {
+			_bench_ = true;
+		} else if (!strcmp(argv[i], "--selftest")) {
+			_selftest_ = true;
+		} else if (!strcmp(argv[i], "--bench-items") && (i + 1) < argc) {
+			_bench_items_ = argCount("--bench-items", argv[++i], SIZE_MAX);
+		} else if (!strcmp(argv[i], "--seed") && (i + 1) < argc) {
+			_seed_ = argNumber("--seed", argv[++i]);
+		} else if (!strcmp(argv[i], "--quiet")) {
+			_quiet_ = true;
+		} else if (!strcmp(argv[i], "--stream")) {
+			_stream_ = true;
+		} else if (!strcmp(argv[i], "--stats") && (i + 1) < argc) {
+			_stats_ = argv[++i];
+		} else if (!strcmp(argv[i], "--mem-report")) {
+			_mem_report_ = true;
+		} else if (!strcmp(argv[i], "--threads") && (i + 1) < argc) {
+			_threads_ = argCount("--threads", argv[++i], UINT_MAX);
+		} else {
+			fprintf(stderr,
+				"usage: %s [--import file.csv] [--snapshot file] [--verify] [--export file.arrow] [--diff old new] "
+				"[--journal file] [--commit-window ms] [--compact MiB] [--pricing file] [--reprice all|lo:hi] [--bench] [--selftest] [--quiet] [--stream] [--threads n] "
+				"[--bench-items n] [--seed n] [--stats file] [--mem-report] "
+				"[--find code] [--delete code] [--cost-range lo:hi] [--top-profit k] "
+				"[--group-by kind[,avail]]\n",
+				argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	// the streaming mode keeps no items to persist, look up, sort, verify or benchmark
+	if (_stream_ && (_snapshot_ || _export_ || _journal_path_ || _find_ || _delete_ || _range_ || _top_ ||
+			 _repricing_ || _verify_ || _bench_)) {
+		fprintf(stderr,
+			"args: --stream only takes --group-by and the import options, "
+			"the items are not kept\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+// splits the next field off the line, quoted fields may embed the delimiter
+static char *splitField (char **line, char *eol, char const delim, char **end)
+{
+	char *iter = *line;
+	while (iter != eol && *iter != delim && *iter <= ' ') {
+		++iter;
+	}
+
+	char *begin = iter;
+	if (iter != eol && *iter == '"') {
+		++iter;
+		begin = iter;
+		char *dst = iter;
+		while (iter != eol) {
+			if (*iter == '"') {
+				if ((iter + 1) != eol && iter[1] == '"') {
+					*dst = '"';
+					++dst;
+					iter += 2;
+					continue;
+				}
+				++iter;
+				break;
+			}
+			*dst = *iter;
+			++dst;
+			++iter;
+		}
+		*end = dst;
+		while (iter != eol && *iter != delim) {
+			++iter;
+		}
+	} else {
+		while (iter != eol && *iter != delim) {
+			++iter;
+		}
+		*end = iter;
+	}
+
+	bool const more = (iter != eol);
+	*line = (more)? (iter + 1) : eol;
+
+	while (*end != begin && (*end)[-1] <= ' ') {
+		--*end;
+	}
+
+	// terminates the field as the console getters do so that it can be parsed alike
+	**end = '\n';
+	return begin;
+}
+
+// applies the rules of validData() without echoing the callback messages
+static bool importNumber (char *text, double *number)
+{
+	bool invalid = parseNumber(text, number);
+	if (*number < 0) {
+		invalid = true;
+	}
+
+	return !invalid;
+}
+
+static void importReject (size_t const line, const char *reason)
+{
+	fprintf(stderr, "import: line %zu: %s\n", line, reason);
+}
+
+// validates the row (code, description, size, availability, cost, count) and prices it as
+// gprice() does, returns why the row is rejected or NULL, it is safe to call from any thread
+static const char *importRow (char *line, char *eol, char const delim, row_t *row)
+{
+	char *end = NULL;
+	char *code = splitField(&line, eol, delim, &end);
+	row->code = code;
+	row->code_len = (end - code);
+	if (!row->code_len) {
+		return "invalid reference code";
+	}
+
+	if (row->code_len > MAX_STRING_LEN) {
+		return "reference code exceeds the max number of chars";
+	}
+
+	char *info = splitField(&line, eol, delim, &end);
+	row->info = info;
+	row->info_len = (end - info);
+	if (!row->info_len) {
+		return "invalid description";
+	}
+
+	if (row->info_len > MAX_STRING_LEN) {
+		return "description exceeds the max number of chars";
+	}
+
+	char *size = splitField(&line, eol, delim, &end);
+	if (!importNumber(size, &row->size)) {
+		return "invalid shoe size";
+	}
+
+	char *avail = splitField(&line, eol, delim, &end);
+	char const c = *avail;
+	if (c == 'y' || c == 'Y') {
+		row->avail = 'Y';
+	} else if (c == 'n' || c == 'N') {
+		row->avail = 'N';
+	} else {
+		return "invalid availability (expects N/Y)";
+	}
+
+	char *cost = splitField(&line, eol, delim, &end);
+	if (!importNumber(cost, &row->cost) || row->cost <= 0) {
+		return "invalid shoe cost";
+	}
+
+	char *count = splitField(&line, eol, delim, &end);
+	if (!importNumber(count, &row->count) || floor(row->count) != ceil(row->count)) {
+		return "invalid shoe count";
+	}
+
+	if (line != eol) {
+		return "unexpected number of fields";
+	}
+
+	row->kind = band(row->cost);
+	row->sale = row->cost * (markup(row->kind) + 1.0);
+	return NULL;
+}
+
+// the first field of a header is code or reference in any case, trimmed and unquoted, the line
+// is read as is since it is parsed again if it is a row
+static bool importHeader (const char *line, const char *eol, char const delim)
+{
+	while (line != eol && *line != delim && *line <= ' ') {
+		++line;
+	}
+
+	char stop = delim;
+	if (line != eol && *line == '"') {
+		stop = '"';
+		++line;
+		while (line != eol && *line != stop && *line <= ' ') {
+			++line;
+		}
+	}
+
+	const char *end = line;
+	while (end != eol && *end != stop) {
+		++end;
+	}
+
+	while (end != line && end[-1] <= ' ') {
+		--end;
+	}
+
+	size_t const len = (end - line);
+	if (len == 4 && !strncasecmp(line, "code", 4)) {
+		return true;
+	}
+
+	if (len == 9 && !strncasecmp(line, "reference", 9)) {
+		return true;
+	}
+
+	return false;
+}
+
+static bool importBlank (const char *line, const char *eol)
+{
+	for (const char *iter = line; iter != eol; ++iter) {
+		if (*iter > ' ') {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void importErr (const char *path, int const fd)
+{
+	fprintf(stderr, "import: %s: %s\n", path, strerror(errno));
+	if (fd != -1) {
+		close(fd);
+	}
+	cleanup();
+	exit(EXIT_FAILURE);
+}
+
+// extrapolates the number of rows of the file from the lines in the first block
+static size_t importEstimate (int const fd, const char *block, size_t const bytes)
+{
+	struct stat st;
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || !bytes) {
+		return 0;
+	}
+
+	size_t lines = 0;
+	const char *iter = block;
+	const char *limit = block + bytes;
+	while ((iter = (const char*) memchr(iter, '\n', limit - iter))) {
+		++lines;
+		++iter;
+	}
+
+	return (lines * (((size_t) st.st_size) / bytes) + lines);
+}
+
+// fills the block with the whole lines that follow the last block, the reader owns the carry
+static bool importFill (importer_t *imp, iblock_t *blk)
+{
+	blk->bytes = 0;
+	blk->done = 0;
+	blk->lines = 0;
+	blk->numel = 0;
+	blk->oversize = false;
+	if (imp->eof) {
+		return false;
+	}
+
+	size_t held = imp->held;
+	memcpy(blk->data, imp->carry, held);
+	imp->held = 0;
+	while (held != IMPORT_BLOCK_SIZE) {
+		ssize_t bytes = read(imp->fd, blk->data + held, IMPORT_BLOCK_SIZE - held);
+		if (bytes == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			imp->error = errno;
+			imp->eof = true;
+			return false;
+		}
+
+		if (bytes == 0) {
+			imp->eof = true;
+			break;
+		}
+
+		if (imp->skip) {
+			char *eol = (char*) memchr(blk->data, '\n', bytes);
+			if (!eol) {
+				continue;
+			}
+			imp->skip = false;
+			++eol;
+			bytes -= (eol - blk->data);
+			memmove(blk->data, eol, bytes);
+		}
+
+		held += bytes;
+	}
+
+	if (!held) {
+		return false;
+	}
+
+	// terminates the last line if the file does not, there is room for an extra byte
+	if (imp->eof && blk->data[held - 1] != '\n') {
+		blk->data[held] = '\n';
+		++held;
+	}
+
+	char *eol = (char*) memrchr(blk->data, '\n', held);
+	if (!eol) {
+		blk->oversize = true;
+		imp->skip = true;
+		return true;
+	}
+
+	blk->bytes = (eol + 1 - blk->data);
+	imp->held = (held - blk->bytes);
+	memcpy(imp->carry, blk->data + blk->bytes, imp->held);
+	return true;
+}
+
+// picks the delimiter from the first line that is not blank and skips the header if any
+static char importStart (iblock_t *blk)
+{
+	char *iter = blk->data;
+	char *limit = blk->data + blk->bytes;
+	char *eol = NULL;
+	while ((eol = (char*) memchr(iter, '\n', limit - iter))) {
+		char *line = iter;
+		iter = eol + 1;
+		if (importBlank(line, eol)) {
+			++blk->lines;
+			continue;
+		}
+
+		char const delim = (memchr(line, '\t', eol - line))? '\t' : ',';
+		if (importHeader(line, eol, delim)) {
+			++blk->lines;
+			blk->done = (iter - blk->data);
+		} else {
+			blk->done = (line - blk->data);
+		}
+		return delim;
+	}
+
+	blk->done = blk->bytes;
+	return ',';
+}
+
+// parses the lines of the block until it runs out of lines or of room for the rows
+static void importScan (iblock_t *blk, char const delim)
+{
+	char *iter = blk->data + blk->done;
+	char *limit = blk->data + blk->bytes;
+	char *eol = NULL;
+	while (blk->numel != IMPORT_ROWS && (eol = (char*) memchr(iter, '\n', limit - iter))) {
+		++blk->lines;
+		char *line = iter;
+		iter = eol + 1;
+		if (importBlank(line, eol)) {
+			continue;
+		}
+
+		row_t *row = &blk->rows[blk->numel];
+		row->line = blk->lines;
+		row->reason = importRow(line, eol, delim, row);
+		++blk->numel;
+	}
+
+	blk->done = (iter - blk->data);
+}
+
+// stores the rows of the block in the order of the lines, parses what the parser left over
+static void importCommit (ItemTable *table,
+			  iblock_t *blk,
+			  char const delim,
+			  size_t *lineno,
+			  size_t *accepted,
+			  size_t *rejected)
+{
+	if (blk->oversize) {
+		++*lineno;
+		++*rejected;
+		importReject(*lineno, "the line exceeds the max number of chars");
+		return;
+	}
+
+	while (true) {
+		for (size_t i = 0; i != blk->numel; ++i) {
+			const row_t *row = &blk->rows[i];
+			if (row->reason) {
+				importReject(*lineno + row->line, row->reason);
+				++*rejected;
+				continue;
+			}
+
+			memcpy(*_code_, row->code, row->code_len);
+			(*_code_)[row->code_len] = 0;
+			memcpy(*_info_, row->info, row->info_len);
+			(*_info_)[row->info_len] = 0;
+			_size_ = row->size;
+			_avail_ = row->avail;
+			_cost_ = row->cost;
+			_kind_ = row->kind;
+			_sale_ = row->sale;
+			_count_ = row->count;
+			gput(table);
+			++*accepted;
+		}
+
+		if (blk->done == blk->bytes) {
+			break;
+		}
+
+		blk->numel = 0;
+		importScan(blk, delim);
+	}
+
+	*lineno += blk->lines;
+}
+
+// reads the blocks that follow the first one as long as there are free slots
+static void importRead (importer_t *imp)
+{
+	size_t seq = 1;
+	while (true) {
+		iblock_t *blk = &imp->blocks[seq % imp->slots];
+		while ((blk->state.load(std::memory_order_acquire) & 3) != BLOCK_FREE) {
+			std::this_thread::yield();
+		}
+
+		if (!importFill(imp, blk)) {
+			break;
+		}
+
+		blk->state.store((seq << 2) | BLOCK_READY, std::memory_order_release);
+		++seq;
+	}
+
+	imp->total.store(seq, std::memory_order_release);
+}
+
+// claims the blocks in turn and parses them, stops when the reader runs out of blocks
+static void importParse (importer_t *imp)
+{
+	while (true) {
+		size_t const seq = imp->next.fetch_add(1);
+		iblock_t *blk = &imp->blocks[seq % imp->slots];
+		size_t const ready = (seq << 2) | BLOCK_READY;
+		while (blk->state.load(std::memory_order_acquire) != ready) {
+			if (seq >= imp->total.load(std::memory_order_acquire)) {
+				return;
+			}
+			std::this_thread::yield();
+		}
+
+		importScan(blk, imp->delim);
+		blk->state.store((seq << 2) | BLOCK_DONE, std::memory_order_release);
+	}
+}
+
+/*
+
+Import Pipeline
+
+With more than one core the import runs in stages. A reader thread fills blocks of whole
+lines, the parser threads validate and price the rows of the blocks they claim, and the
+calling thread commits the rows to the store in the order of the blocks. The stages share a
+ring of 2 * parsers blocks whose states (free, ready, done) are tagged with the sequence
+number of the block, so the ring is a bounded lock-free queue between the stages: the reader
+waits for a free slot, a parser for a ready block and the committer for the next block in
+order. Only the committer allocates (gput() and the string heap), the reader and the parsers
+work in buffers that the committer allocates beforehand. Rows that do not fit in the room of
+a block are parsed by the committer.
+
+*/
+
+void import (const char *path, ItemTable *table)
+{
+	int const fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		importErr(path, fd);
+	}
+
+	unsigned const parsers = workers();
+	importer_t imp;
+	imp.fd = fd;
+	imp.error = 0;
+	imp.delim = ',';
+	imp.eof = false;
+	imp.skip = false;
+	imp.held = 0;
+	imp.slots = (parsers > 1)? (2 * parsers) : 1;
+	imp.next.store(0);
+	imp.total.store(NPOS);
+	imp.carry = (char*) Util_Malloc(IMPORT_BLOCK_SIZE, M_BUFFER);
+	imp.blocks = (iblock_t*) Util_Malloc(imp.slots * sizeof(iblock_t));
+	if (!imp.carry || !imp.blocks) {
+		importErr(path, fd);
+	}
+
+	for (size_t i = 0; i != imp.slots; ++i) {
+		iblock_t *blk = ::new ((void*) &imp.blocks[i]) iblock_t();
+		// reserves an extra byte to terminate the last line if the file does not
+		blk->data = (char*) Util_Malloc(IMPORT_BLOCK_SIZE + 1, M_BUFFER);
+		blk->rows = (row_t*) Util_Malloc(IMPORT_ROWS * sizeof(row_t), M_BUFFER);
+		blk->state.store(BLOCK_FREE);
+		if (!blk->data || !blk->rows) {
+			importErr(path, fd);
+		}
+	}
+
+	size_t lineno = 0;
+	size_t accepted = 0;
+	size_t rejected = 0;
+	iblock_t *first = &imp.blocks[0];
+	if (importFill(&imp, first)) {
+		// the streaming mode folds the rows, the table does not grow
+		if (!_stream_) {
+			size_t const rows = importEstimate(fd, first->data, first->bytes);
+			if (table->reserve(table->numel() + rows) != 0) {
+				importErr(path, fd);
+			}
+		}
+
+		imp.delim = importStart(first);
+		if (imp.slots == 1) {
+			do {
+				importScan(first, imp.delim);
+				importCommit(table, first, imp.delim, &lineno, &accepted, &rejected);
+			} while (importFill(&imp, first));
+		} else {
+			first->state.store(BLOCK_READY, std::memory_order_release);
+			std::thread reader(importRead, &imp);
+			std::thread *threads = (std::thread*) Util_Malloc(parsers * sizeof(std::thread));
+			if (!threads) {
+				importErr(path, fd);
+			}
+
+			for (unsigned i = 0; i != parsers; ++i) {
+				::new ((void*) &threads[i]) std::thread(importParse, &imp);
+			}
+
+			for (size_t seq = 0; ; ++seq) {
+				iblock_t *blk = &imp.blocks[seq % imp.slots];
+				size_t const done = (seq << 2) | BLOCK_DONE;
+				bool more = true;
+				while (blk->state.load(std::memory_order_acquire) != done) {
+					if (seq >= imp.total.load(std::memory_order_acquire)) {
+						more = false;
+						break;
+					}
+					std::this_thread::yield();
+				}
+
+				if (!more) {
+					break;
+				}
+
+				importCommit(table, blk, imp.delim, &lineno, &accepted, &rejected);
+				blk->state.store((seq << 2) | BLOCK_FREE, std::memory_order_release);
+			}
+
+			reader.join();
+			for (unsigned i = 0; i != parsers; ++i) {
+				threads[i].join();
+				threads[i].~thread();
+			}
+			threads = (std::thread*) Util_Free(threads);
+		}
+	}
+
+	if (imp.error) {
+		errno = imp.error;
+		importErr(path, fd);
+	}
+
+	close(fd);
+	for (size_t i = 0; i != imp.slots; ++i) {
+		imp.blocks[i].data = (char*) Util_Free(imp.blocks[i].data);
+		imp.blocks[i].rows = (row_t*) Util_Free(imp.blocks[i].rows);
+		imp.blocks[i].~iblock_t();
+	}
+	imp.blocks = (iblock_t*) Util_Free(imp.blocks);
+	imp.carry = (char*) Util_Free(imp.carry);
+	if (_journal_) {
+		_journal_->ack(table->_lsn_);
+	}
+
+	printf("IMPORTED ITEMS: %zu\n", accepted);
+	printf("REJECTED ROWS: %zu\n", rejected);
+	if (!_stream_) {
+		printf("DISTINCT ITEMS: %zu\n", table->numel());
+	}
+}
+
+// multiply-xorshift checksum of the bytes, the words are read in the byte order of the host
+static uint64_t checksum (const void *data, size_t const size, uint64_t hash)
+{
+	const unsigned char *bytes = (const unsigned char*) data;
+	size_t const words = size / sizeof(uint64_t);
+	for (size_t i = 0; i != words; ++i) {
+		uint64_t word = 0;
+		memcpy(&word, bytes + i * sizeof(uint64_t), sizeof(uint64_t));
+		hash = (hash ^ word) * 0x9e3779b97f4a7c15;
+		hash ^= (hash >> 29);
+	}
+
+	for (size_t i = words * sizeof(uint64_t); i != size; ++i) {
+		hash = (hash ^ bytes[i]) * 0x00000100000001b3;
+	}
+
+	return hash;
+}
+
+static uint64_t hchecksum (const snapshot_t *header)
+{
+	return checksum(header, offsetof(snapshot_t, hchecksum), HASH);
+}
+
+// writes the gathered buffers, resuming after partial writes
+static int writeAll (int const fd, struct iovec *iov, int count)
+{
+	int rc = 0;
+	while (count) {
+		ssize_t bytes = writev(fd, iov, count);
+		if (bytes == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			rc = -1;
+			return rc;
+		}
+
+		while (count && (size_t) bytes >= iov->iov_len) {
+			bytes -= iov->iov_len;
+			++iov;
+			--count;
+		}
+
+		if (count) {
+			iov->iov_base = ((char*) iov->iov_base) + bytes;
+			iov->iov_len -= bytes;
+		}
+	}
+
+	return rc;
+}
+
+int Reader::open (int const fd, size_t const size)
+{
+	int rc = 0;
+	this->_buffer_ = (char*) Util_Malloc(size, M_BUFFER);
+	if (!this->_buffer_) {
+		rc = -1;
+		return rc;
+	}
+
+	this->_fd_ = fd;
+	this->_size_ = size;
+	this->_head_ = 0;
+	this->_used_ = 0;
+	return rc;
+}
+
+/*
+
+returns the next line, newline included, as a view into the block and its number of chars, or
+-1 at the end of the input (errno is zero) or on error. The block is refilled with one read()
+once its lines are used up, the partial line at its end is moved to the front first. A line
+longer than MAX_STRING_LEN is dropped as it is read and only its number of chars is returned.
+A missing newline at the end of the input is supplied, the last byte of the block is kept for
+it. Stdout is flushed before reading so that the prompts are out when the input is a terminal.
+
+*/
+
+ssize_t Reader::line (char **text)
+{
+	char *buffer = this->_buffer_;
+	size_t scanned = this->_head_;	// bytes of the line searched for its newline
+	size_t dropped = 0;		// chars of an overlong line read so far
+	while (true) {
+		char *eol = (char*) memchr(buffer + scanned, '\n', this->_used_ - scanned);
+		if (eol) {
+			size_t const chars = (eol + 1) - (buffer + this->_head_);
+			*text = buffer + this->_head_;
+			this->_head_ += chars;
+			return (dropped + chars);
+		}
+
+		size_t const pending = this->_used_ - this->_head_;
+		if (pending > MAX_STRING_LEN) {
+			dropped += pending;
+			this->_used_ = 0;
+		} else if (this->_head_) {
+			memmove(buffer, buffer + this->_head_, pending);
+			this->_used_ = pending;
+		}
+		this->_head_ = 0;
+		scanned = this->_used_;
+
+		fflush(stdout);
+		ssize_t const bytes = read(this->_fd_,
+					   buffer + this->_used_,
+					   (this->_size_ - 1) - this->_used_);
+		if (bytes == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+
+		if (!bytes) {
+			if (!this->_used_ && !dropped) {
+				errno = 0;
+				return -1;
+			}
+			buffer[this->_used_++] = '\n';
+			continue;
+		}
+
+		this->_used_ += bytes;
+	}
+}
+
+void *Reader::operator new (size_t size)
+{
+	return Util_PoolMalloc(size);
+}
+
+void Reader::operator delete (void *p)
+{
+	p = Util_Free(p);
+}
+
+int Writer::open (int const fd, size_t const size)
+{
+	int rc = 0;
+	this->_buffer_ = (char*) Util_Malloc(size, M_BUFFER);
+	if (!this->_buffer_) {
+		rc = -1;
+		return rc;
+	}
+
+	this->_fd_ = fd;
+	this->_size_ = size;
+	this->_used_ = 0;
+	return rc;
+}
+
+// a run as large as the buffer is written out as is, after what is buffered
+Writer &Writer::bytes (const void *data, size_t len)
+{
+	const char *str = (const char*) data;
+	if (len >= this->_size_) {
+		this->flush();
+		struct iovec iov = {(void*) str, len};
+		if (!this->_error_ && writeAll(this->_fd_, &iov, 1) != 0) {
+			this->_error_ = errno;
+		}
+		return *this;
+	}
+
+	while (len) {
+		if (this->_used_ == this->_size_) {
+			this->flush();
+		}
+
+		size_t const room = (this->_size_ - this->_used_);
+		size_t const bytes = (len < room)? len : room;
+		memcpy(this->_buffer_ + this->_used_, str, bytes);
+		this->_used_ += bytes;
+		str += bytes;
+		len -= bytes;
+	}
+
+	return *this;
+}
+
+Writer &Writer::text (const char *str)
+{
+	return this->bytes(str, strlen(str));
+}
+
+Writer &Writer::put (char const c)
+{
+	if (this->_used_ == this->_size_) {
+		this->flush();
+	}
+
+	this->_buffer_[this->_used_++] = c;
+	return *this;
+}
+
+/*
+
+formats the number as printf("%.*f") does. Numbers that scale to less than 2^52 are rounded
+to integers, the halfway cases are resolved with the rounding error of the scaling as the
+scaled number is not exact in general, and the ties (exact halves) are broken to even as
+glibc does. The rest of the numbers (and the infinities and NaNs) go through snprintf().
+
+*/
+
+Writer &Writer::fixed (double x, int const prec)
+{
+	static double const scales[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+	double const limit = 4503599627370496.0;	// 2^52
+	if (prec < 0 || prec > 9 || !std::isfinite(x) || fabs(x) * scales[prec] >= limit) {
+		char str[512];
+		snprintf(str, sizeof(str), "%.*f", prec, x);
+		return this->text(str);
+	}
+
+	bool const negative = std::signbit(x);
+	x = fabs(x);
+	double const scale = scales[prec];
+	double const scaled = x * scale;
+	double units = floor(scaled);
+	double const frac = (scaled - units);
+	if (frac > 0.5) {
+		units += 1;
+	} else if (frac == 0.5) {
+		double const err = fma(x, scale, -scaled);
+		if (err > 0 || (err == 0 && fmod(units, 2) != 0)) {
+			units += 1;
+		}
+	}
+
+	char digits[32];
+	uint64_t n = (uint64_t) units;
+	char *end = digits + sizeof(digits);
+	char *iter = end;
+	for (int i = 0; i != prec; ++i) {
+		*--iter = (char) ('0' + (n % 10));
+		n /= 10;
+	}
+
+	if (prec) {
+		*--iter = '.';
+	}
+
+	do {
+		*--iter = (char) ('0' + (n % 10));
+		n /= 10;
+	} while (n);
+
+	if (negative) {
+		*--iter = '-';
+	}
+
+	size_t const len = (end - iter);
+	if ((this->_size_ - this->_used_) < len) {
+		this->flush();
+	}
+
+	memcpy(this->_buffer_ + this->_used_, iter, len);
+	this->_used_ += len;
+	return *this;
+}
+
+// writes the line "LABEL: x" with the precision of printf("%.*f")
+Writer &Writer::field (const char *label, double const x, int const prec)
+{
+	return this->text(label).text(": ").fixed(x, prec).put('\n');
+}
+
+Writer &Writer::field (const char *label, const char *str)
+{
+	return this->text(label).text(": ").text(str).put('\n');
+}
+
+// flushes stdio first so that the reports are written after what was printed before them
+int Writer::flush ()
+{
+	int rc = 0;
+	fflush(stdout);
+	if (this->_used_ && !this->_error_) {
+		struct iovec iov = {this->_buffer_, this->_used_};
+		if (writeAll(this->_fd_, &iov, 1) != 0) {
+			this->_error_ = errno;
+		}
+	}
+
+	this->_used_ = 0;
+	if (this->_error_) {
+		rc = -1;
+	}
+
+	return rc;
+}
+
+void *Writer::operator new (size_t size)
+{
+	return Util_PoolMalloc(size);
+}
+
+void Writer::operator delete (void *p)
+{
+	p = Util_Free(p);
+}
+
+static void snapshotErr (const char *fname, const char *path, const char *msg)
+{
+	fprintf(stderr, "%s: %s: %s\n", fname, path, msg);
+	cleanup();
+	exit(EXIT_FAILURE);
+}
+
+// writes the header and the columns with a single gathering write into a file that replaces the
+// snapshot once it is on disk
+void save (ItemTable *table, const char *path)
+{
+	size_t const numel = table->numel();
+	const void *data[SNAPSHOT_SECTIONS] = {
+		table->_cost_.begin(),
+		table->_sale_.begin(),
+		table->_count_.begin(),
+		table->_size_.begin(),
+		table->_kind_.begin(),
+		table->_avail_.begin(),
+		table->_code_.begin(),
+		table->_info_.begin(),
+		table->_heap_.begin()
+	};
+
+	size_t const sizes[SNAPSHOT_SECTIONS] = {
+		numel * sizeof(double),
+		numel * sizeof(double),
+		numel * sizeof(double),
+		numel * sizeof(double),
+		numel * sizeof(Kind),
+		numel * sizeof(char),
+		numel * sizeof(size_t),
+		numel * sizeof(size_t),
+		table->_heap_.numel()
+	};
+
+	static const char pad[SNAPSHOT_ALIGN] = {0};
+	snapshot_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	header.version = SNAPSHOT_VERSION;
+	header.endian = SNAPSHOT_ENDIAN;
+	header.numel = numel;
+	header.heap = table->_heap_.numel();
+	header.lsn = table->_lsn_;
+	memcpy(header.totals, table->_totals_, sizeof(header.totals));
+
+	struct iovec iov[2 * SNAPSHOT_SECTIONS + 1];
+	int count = 0;
+	iov[count].iov_base = &header;
+	iov[count].iov_len = sizeof(header);
+	++count;
+
+	uint64_t sum = HASH;
+	size_t offset = sizeof(header);
+	for (size_t i = 0; i != SNAPSHOT_SECTIONS; ++i) {
+		size_t const aligned = (offset + (SNAPSHOT_ALIGN - 1)) & ~((size_t) SNAPSHOT_ALIGN - 1);
+		if (aligned != offset) {
+			iov[count].iov_base = (void*) pad;
+			iov[count].iov_len = (aligned - offset);
+			++count;
+		}
+
+		iov[count].iov_base = (void*) data[i];
+		iov[count].iov_len = sizes[i];
+		++count;
+
+		header.offset[i] = aligned;
+		sum = checksum(data[i], sizes[i], sum);
+		offset = aligned + sizes[i];
+	}
+
+	header.size = offset;
+	header.checksum = sum;
+	header.hchecksum = hchecksum(&header);
+
+	size_t const len = strlen(path);
+	char *temp = (char*) Util_Malloc(len + sizeof(".tmp"));
+	if (!temp) {
+		snapshotErr("save", path, "error");
+	}
+	memcpy(temp, path, len);
+	memcpy(temp + len, ".tmp", sizeof(".tmp"));
+
+	int const fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		snapshotErr("save", temp, strerror(errno));
+	}
+
+	if (writeAll(fd, iov, count) != 0 || fsync(fd) == -1) {
+		int const err = errno;
+		close(fd);
+		unlink(temp);
+		snapshotErr("save", temp, strerror(err));
+	}
+
+	if (close(fd) == -1 || rename(temp, path) == -1) {
+		int const err = errno;
+		unlink(temp);
+		snapshotErr("save", path, strerror(err));
+	}
+
+	temp = (char*) Util_Free(temp);
+}
+
+// size of the section in bytes
+static size_t snapshotSection (const snapshot_t *header, size_t const i)
+{
+	size_t const sizes[SNAPSHOT_SECTIONS] = {
+		sizeof(double),
+		sizeof(double),
+		sizeof(double),
+		sizeof(double),
+		sizeof(Kind),
+		sizeof(char),
+		sizeof(size_t),
+		sizeof(size_t),
+		0
+	};
+
+	return (i + 1 == SNAPSHOT_SECTIONS)? header->heap : header->numel * sizes[i];
+}
+
+static bool snapshotValid (const snapshot_t *header, size_t const size)
+{
+	if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) ||
+	    header->version != SNAPSHOT_VERSION ||
+	    header->endian != SNAPSHOT_ENDIAN ||
+	    header->hchecksum != hchecksum(header) ||
+	    header->size != size) {
+		return false;
+	}
+
+	for (size_t i = 0; i != SNAPSHOT_SECTIONS; ++i) {
+		size_t const offset = header->offset[i];
+		size_t const len = snapshotSection(header, i);
+		if ((offset % SNAPSHOT_ALIGN) || offset > size || len > (size - offset)) {
+			return false;
+		}
+	}
+
+	// every string ends within the heap once its offset is below the heap size
+	const char *base = (const char*) header;
+	if (header->numel && (!header->heap || base[header->offset[8] + header->heap - 1] != '\0')) {
+		return false;
+	}
+
+	return true;
+}
+
+static bool snapshotVerify (const snapshot_t *header, const char *base)
+{
+	uint64_t sum = HASH;
+	for (size_t i = 0; i != SNAPSHOT_SECTIONS; ++i) {
+		sum = checksum(base + header->offset[i], snapshotSection(header, i), sum);
+	}
+
+	return (sum == header->checksum);
+}
+
+// maps and validates the snapshot, NULL if there is none, the pages are faulted in as they are
+// first touched
+static void *snapshotMap (const char *fname, const char *path, int const prot, size_t *size)
+{
+	int const fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		if (errno == ENOENT) {
+			return NULL;
+		}
+		snapshotErr(fname, path, strerror(errno));
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		int const err = errno;
+		close(fd);
+		snapshotErr(fname, path, strerror(err));
+	}
+
+	*size = st.st_size;
+	if (*size < sizeof(snapshot_t)) {
+		close(fd);
+		snapshotErr(fname, path, "not a snapshot");
+	}
+
+	void *p = mmap(NULL, *size, prot, MAP_PRIVATE, fd, 0);
+	int const err = errno;
+	close(fd);
+	if (p == MAP_FAILED) {
+		snapshotErr(fname, path, strerror(err));
+	}
+
+	const snapshot_t *header = (const snapshot_t*) p;
+	if (!snapshotValid(header, *size)) {
+		munmap(p, *size);
+		snapshotErr(fname, path, "not a snapshot or corrupted header");
+	}
+
+	if (_verify_ && !snapshotVerify(header, (const char*) p)) {
+		munmap(p, *size);
+		snapshotErr(fname, path, "checksum mismatch");
+	}
+
+	return p;
+}
+
+void load (ItemTable *table, const char *path)
+{
+	size_t size = 0;
+	void *p = snapshotMap("load", path, PROT_READ | PROT_WRITE, &size);
+	if (!p) {
+		return;
+	}
+
+	_map_ = p;
+	_map_size_ = size;
+	table->attach((const snapshot_t*) p, (char*) p);
+	printf("LOADED ITEMS: %zu\n", table->numel());
+}
+
+static void arrowErr (const char *fname, const char *path, const char *msg)
+{
+	fprintf(stderr, "%s: %s: %s\n", fname, path, msg);
+	cleanup();
+	exit(EXIT_FAILURE);
+}
+
+// stores the low-order bytes of the value in little-endian order, as the flatbuffers are
+static void arrowPut (uint8_t *dst, uint64_t const value, size_t const bytes)
+{
+	for (size_t i = 0; i != bytes; ++i) {
+		dst[i] = (uint8_t) (value >> (8 * i));
+	}
+}
+
+static void fbReset (fbuilder_t *fb)
+{
+	fb->head = ARROW_META_SIZE;
+	fb->minalign = 1;
+	fb->start = 0;
+	fb->slots = 0;
+}
+
+static size_t fbSize (const fbuilder_t *fb)
+{
+	return (ARROW_META_SIZE - fb->head);
+}
+
+static void fbPush (fbuilder_t *fb, const void *data, size_t const bytes)
+{
+	if (bytes > fb->head) {
+		fprintf(stderr, "fbPush: the metadata exceeds %d bytes\n", ARROW_META_SIZE);
+		cleanup();
+		exit(EXIT_FAILURE);
+	}
+
+	fb->head -= bytes;
+	if (bytes) {
+		memcpy(fb->data + fb->head, data, bytes);
+	}
+}
+
+// pads so that the size is a multiple of align once the next bytes are pushed
+static void fbAlign (fbuilder_t *fb, size_t const align, size_t const bytes)
+{
+	static const uint8_t zeros[ARROW_ALIGN] = {0};
+	if (align > fb->minalign) {
+		fb->minalign = align;
+	}
+
+	size_t const pad = (align - ((fbSize(fb) + bytes) & (align - 1))) & (align - 1);
+	fbPush(fb, zeros, pad);
+}
+
+static void fbScalar (fbuilder_t *fb, uint64_t const value, size_t const bytes)
+{
+	uint8_t le[sizeof(uint64_t)];
+	arrowPut(le, value, bytes);
+	fbAlign(fb, bytes, 0);
+	fbPush(fb, le, bytes);
+}
+
+// pushes the offset to an object built before, it counts from the offset itself
+static void fbOffset (fbuilder_t *fb, size_t const target)
+{
+	fbAlign(fb, sizeof(uint32_t), 0);
+	fbScalar(fb, (fbSize(fb) + sizeof(uint32_t)) - target, sizeof(uint32_t));
+}
+
+static void fbTable (fbuilder_t *fb, size_t const slots)
+{
+	fb->start = fbSize(fb);
+	fb->slots = slots;
+	memset(fb->field, 0, sizeof(fb->field));
+}
+
+static void fbField (fbuilder_t *fb, size_t const slot, uint64_t const value, size_t const bytes)
+{
+	fbScalar(fb, value, bytes);
+	fb->field[slot] = fbSize(fb);
+}
+
+static void fbRef (fbuilder_t *fb, size_t const slot, size_t const target)
+{
+	fbOffset(fb, target);
+	fb->field[slot] = fbSize(fb);
+}
+
+// closes the table with its vtable: sizes of the vtable and the table, then the field offsets
+static size_t fbEnd (fbuilder_t *fb)
+{
+	fbScalar(fb, 0, sizeof(int32_t));
+	size_t const table = fbSize(fb);
+	size_t slots = fb->slots;
+	while (slots && !fb->field[slots - 1]) {
+		--slots;
+	}
+
+	for (size_t i = slots; i-- != 0; ) {
+		fbScalar(fb, (fb->field[i])? (table - fb->field[i]) : 0, sizeof(uint16_t));
+	}
+	fbScalar(fb, table - fb->start, sizeof(uint16_t));
+	fbScalar(fb, 2 * (slots + 2), sizeof(uint16_t));
+
+	// the vtable precedes the table, the table refers to it with a signed offset
+	arrowPut(fb->data + (ARROW_META_SIZE - table), fbSize(fb) - table, sizeof(int32_t));
+	return table;
+}
+
+static size_t fbString (fbuilder_t *fb, const char *str)
+{
+	size_t const len = strlen(str);
+	fbAlign(fb, sizeof(uint32_t), len + 1);
+	fbPush(fb, "", 1);
+	fbPush(fb, str, len);
+	fbScalar(fb, len, sizeof(uint32_t));
+	return fbSize(fb);
+}
+
+static size_t fbRefs (fbuilder_t *fb, const size_t *targets, size_t const numel)
+{
+	fbAlign(fb, sizeof(uint32_t), numel * sizeof(uint32_t));
+	for (size_t i = numel; i-- != 0; ) {
+		fbOffset(fb, targets[i]);
+	}
+	fbScalar(fb, numel, sizeof(uint32_t));
+	return fbSize(fb);
+}
+
+// vector of structs that are already laid out, they are aligned to eight bytes
+static size_t fbStructs (fbuilder_t *fb, const uint8_t *data, size_t const size, size_t const numel)
+{
+	fbAlign(fb, sizeof(uint32_t), size * numel);
+	fbAlign(fb, sizeof(uint64_t), size * numel);
+	fbPush(fb, data, size * numel);
+	fbScalar(fb, numel, sizeof(uint32_t));
+	return fbSize(fb);
+}
+
+static size_t fbFinish (fbuilder_t *fb, size_t const root)
+{
+	fbAlign(fb, fb->minalign, sizeof(uint32_t));
+	fbOffset(fb, root);
+	return fbSize(fb);
+}
+
+static size_t arrowSchema (fbuilder_t *fb)
+{
+	static const char *names[ARROW_FIELDS] = {
+		"code", "description", "size", "available", "cost",
+		"sale", "count", "kind", "total_cost", "net_profit"
+	};
+
+	static const uint8_t types[ARROW_FIELDS] = {
+		ARROW_LARGE_UTF8, ARROW_LARGE_UTF8, ARROW_FLOAT, ARROW_BOOL, ARROW_FLOAT,
+		ARROW_FLOAT, ARROW_FLOAT, ARROW_LARGE_UTF8, ARROW_FLOAT, ARROW_FLOAT
+	};
+
+	size_t fields[ARROW_FIELDS];
+	for (size_t i = 0; i != ARROW_FIELDS; ++i) {
+		size_t const name = fbString(fb, names[i]);
+		size_t const children = fbRefs(fb, NULL, 0);
+		fbTable(fb, 1);
+		if (types[i] == ARROW_FLOAT) {
+			fbField(fb, 0, ARROW_DOUBLE, sizeof(uint16_t));
+		}
+		size_t const type = fbEnd(fb);
+
+		// name, nullable, type_type, type, dictionary, children
+		fbTable(fb, 6);
+		fbRef(fb, 0, name);
+		fbRef(fb, 3, type);
+		fbRef(fb, 5, children);
+		fbField(fb, 1, 0, sizeof(uint8_t));
+		fbField(fb, 2, types[i], sizeof(uint8_t));
+		fields[i] = fbEnd(fb);
+	}
+
+	uint16_t const probe = 1;
+	bool const big = (*((const uint8_t*) &probe) == 0);
+	size_t const vector = fbRefs(fb, fields, ARROW_FIELDS);
+	fbTable(fb, 2);
+	fbRef(fb, 1, vector);
+	fbField(fb, 0, big, sizeof(uint16_t));
+	return fbEnd(fb);
+}
+
+static size_t arrowMessage (fbuilder_t *fb, uint8_t const type, size_t const header, uint64_t const body)
+{
+	// version, header_type, header, bodyLength
+	fbTable(fb, 4);
+	fbField(fb, 3, body, sizeof(uint64_t));
+	fbRef(fb, 2, header);
+	fbField(fb, 0, ARROW_V5, sizeof(uint16_t));
+	fbField(fb, 1, type, sizeof(uint8_t));
+	return fbFinish(fb, fbEnd(fb));
+}
+
+// the nodes (length and null count) of the columns and the buffers (offset and length) of the body
+static size_t arrowBatch (fbuilder_t *fb, uint64_t const numel, const uint64_t *offsets, const uint64_t *lengths)
+{
+	uint8_t nodes[ARROW_FIELDS * 16];
+	for (size_t i = 0; i != ARROW_FIELDS; ++i) {
+		arrowPut(&nodes[16 * i], numel, sizeof(uint64_t));
+		arrowPut(&nodes[16 * i + 8], 0, sizeof(uint64_t));
+	}
+
+	uint8_t buffers[ARROW_BUFFERS * 16];
+	for (size_t b = 0; b != ARROW_BUFFERS; ++b) {
+		arrowPut(&buffers[16 * b], offsets[b], sizeof(uint64_t));
+		arrowPut(&buffers[16 * b + 8], lengths[b], sizeof(uint64_t));
+	}
+
+	size_t const vnodes = fbStructs(fb, nodes, 16, ARROW_FIELDS);
+	size_t const vbuffers = fbStructs(fb, buffers, 16, ARROW_BUFFERS);
+	// length, nodes, buffers
+	fbTable(fb, 3);
+	fbField(fb, 0, numel, sizeof(uint64_t));
+	fbRef(fb, 1, vnodes);
+	fbRef(fb, 2, vbuffers);
+	return fbEnd(fb);
+}
+
+// the block (offset, metadata length and body length) locates the record batch in the file
+static size_t arrowFooter (fbuilder_t *fb, uint64_t const offset, uint32_t const meta, uint64_t const body)
+{
+	uint8_t block[24] = {0};
+	arrowPut(&block[0], offset, sizeof(uint64_t));
+	arrowPut(&block[8], meta, sizeof(uint32_t));
+	arrowPut(&block[16], body, sizeof(uint64_t));
+	size_t const schema = arrowSchema(fb);
+	size_t const dictionaries = fbStructs(fb, NULL, 24, 0);
+	size_t const batches = fbStructs(fb, block, 24, 1);
+	// version, schema, dictionaries, recordBatches
+	fbTable(fb, 4);
+	fbRef(fb, 1, schema);
+	fbRef(fb, 2, dictionaries);
+	fbRef(fb, 3, batches);
+	fbField(fb, 0, ARROW_V5, sizeof(uint16_t));
+	return fbFinish(fb, fbEnd(fb));
+}
+
+static uint64_t arrowAlign (uint64_t const bytes)
+{
+	return (bytes + (ARROW_ALIGN - 1)) & ~((uint64_t) ARROW_ALIGN - 1);
+}
+
+static void arrowPad (Writer *out, uint64_t const bytes)
+{
+	static const char zeros[ARROW_ALIGN] = {0};
+	out->bytes(zeros, arrowAlign(bytes) - bytes);
+}
+
+// writes the message framed by the continuation marker and its size, returns the bytes written
+static uint64_t arrowFrame (Writer *out, const fbuilder_t *fb)
+{
+	uint64_t const meta = arrowAlign(fbSize(fb));
+	uint8_t prefix[8];
+	arrowPut(&prefix[0], 0xffffffff, sizeof(uint32_t));
+	arrowPut(&prefix[4], meta, sizeof(uint32_t));
+	out->bytes(prefix, sizeof(prefix));
+	out->bytes(fb->data + fb->head, fbSize(fb));
+	arrowPad(out, fbSize(fb));
+	return (sizeof(prefix) + meta);
+}
+
+typedef const char *(*label_t)(ItemTable *table, size_t i);
+
+static const char *arrowCode (ItemTable *table, size_t const i)
+{
+	return table->text(table->_code_[i]);
+}
+
+static const char *arrowInfo (ItemTable *table, size_t const i)
 {
-	char *text = NULL;
-	ssize_t chars = 0;
-	bool invalid = true;
-	memset(*_temp_, 0, _sz_);
-	char prompt[] = "Input N/Y if the shoe is (un)available for sale:";
-	printf("%s", prompt);
-	do {
-		errno = 0;
-		chars = getline(_temp_, &_sz_, stdin);
-		if (chars == -1) {
+	return table->text(table->_info_[i]);
+}
 
-			if (errno) {
-				fprintf(stderr, "gavail: %s\n", strerror(errno));
-				cleanup();
-				exit(EXIT_FAILURE);
-			}
+static const char *arrowKind (ItemTable *table, size_t const i)
+{
+	Kind *kind = &table->_kind_[i];
+	return kind->stringify(kind);
+}
 
-			clearerr(stdin);
-			printf("\nPlease input N/Y\n");
-			printf("%s", prompt);
+static uint64_t arrowChars (ItemTable *table, label_t const label)
+{
+	uint64_t chars = 0;
+	size_t const numel = table->numel();
+	for (size_t i = 0; i != numel; ++i) {
+		chars += strlen(label(table, i));
+	}
 
-		} else if (chars > MAX_STRING_LEN) {
+	return chars;
+}
 
-			invalid = true;
-			char msg[] = "The input exceeds the max number of chars %d\n";
-			printf(msg, MAX_STRING_LEN);
-			printf("Please input just N/Y\n");
-			*_temp_ = (char*) realloc(*_temp_, MAX_BUFFER_SIZE);
-			if (!*_temp_) {
-				fprintf(stderr, "gavail: %s\n", strerror(errno));
-				cleanup();
-				exit(EXIT_FAILURE);
+// writes the offsets of the strings of the column and then the strings, each buffer padded
+static void arrowText (Writer *out, ItemTable *table, label_t const label)
+{
+	size_t const numel = table->numel();
+	uint64_t offset = 0;
+	out->bytes(&offset, sizeof(offset));
+	for (size_t i = 0; i != numel; ++i) {
+		offset += strlen(label(table, i));
+		out->bytes(&offset, sizeof(offset));
+	}
+	arrowPad(out, (numel + 1) * sizeof(uint64_t));
+
+	for (size_t i = 0; i != numel; ++i) {
+		const char *str = label(table, i);
+		out->bytes(str, strlen(str));
+	}
+	arrowPad(out, offset);
+}
+
+static void arrowColumn (Writer *out, const double *column, size_t const numel)
+{
+	out->bytes(column, numel * sizeof(double));
+	arrowPad(out, numel * sizeof(double));
+}
+
+// bit i of the bitmap is set if the item i is available, the least significant bit first
+static void arrowAvail (Writer *out, ItemTable *table)
+{
+	const char *avail = table->_avail_.begin();
+	size_t const numel = table->numel();
+	for (size_t i = 0; i < numel; i += 8) {
+		uint8_t bits = 0;
+		for (size_t j = i; j != i + 8 && j != numel; ++j) {
+			bits |= (uint8_t) ((avail[j] == 'Y') << (j - i));
+		}
+		out->put((char) bits);
+	}
+	arrowPad(out, (numel + 7) / 8);
+}
+
+// total cost (count * cost) if net is false, else net profit (count * (sale - cost))
+static void arrowDerived (Writer *out, ItemTable *table, bool const net)
+{
+	const double *cost = table->_cost_.begin();
+	const double *sale = table->_sale_.begin();
+	const double *count = table->_count_.begin();
+	size_t const numel = table->numel();
+	for (size_t i = 0; i != numel; ++i) {
+		double const x = (net)? count[i] * (sale[i] - cost[i]) : count[i] * cost[i];
+		out->bytes(&x, sizeof(x));
+	}
+	arrowPad(out, numel * sizeof(double));
+}
+
+/*
+
+writes the items as an Arrow IPC file into a file that replaces the export once it is on disk.
+The lengths of the string columns are summed first so that the record batch message, which
+locates every buffer of the body, is written ahead of the body. The columns of numbers are
+written from the item store as they are, the rest is rendered through the buffer of a Writer.
+
+*/
+
+void arrow (ItemTable *table, const char *path)
+{
+	uint64_t const numel = table->numel();
+	uint64_t const codes = arrowChars(table, arrowCode);
+	uint64_t const infos = arrowChars(table, arrowInfo);
+	uint64_t const kinds = arrowChars(table, arrowKind);
+	uint64_t const offsets = (numel + 1) * sizeof(uint64_t);
+	uint64_t const column = numel * sizeof(double);
+	uint64_t const lengths[ARROW_BUFFERS] = {
+		0, offsets, codes,		// code
+		0, offsets, infos,		// description
+		0, column,			// size
+		0, (numel + 7) / 8,		// available
+		0, column,			// cost
+		0, column,			// sale
+		0, column,			// count
+		0, offsets, kinds,		// kind
+		0, column,			// total_cost
+		0, column			// net_profit
+	};
+
+	uint64_t starts[ARROW_BUFFERS];
+	uint64_t body = 0;
+	for (size_t b = 0; b != ARROW_BUFFERS; ++b) {
+		starts[b] = body;
+		body += arrowAlign(lengths[b]);
+	}
+
+	size_t const len = strlen(path);
+	char *temp = (char*) Util_Malloc(len + sizeof(".tmp"));
+	if (!temp) {
+		arrowErr("arrow", path, "error");
+	}
+	memcpy(temp, path, len);
+	memcpy(temp + len, ".tmp", sizeof(".tmp"));
+
+	int const fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		arrowErr("arrow", temp, strerror(errno));
+	}
+
+	fbuilder_t *fb = (fbuilder_t*) Util_Malloc(sizeof(fbuilder_t), M_BUFFER);
+	Writer out;
+	if (!fb || out.open(fd, ARROW_BUFFER_SIZE) != 0) {
+		int const err = errno;
+		close(fd);
+		unlink(temp);
+		arrowErr("arrow", temp, strerror(err));
+	}
+
+	static const char magic[ARROW_ALIGN] = ARROW_MAGIC;
+	out.bytes(magic, sizeof(magic));
+	fbReset(fb);
+	arrowMessage(fb, ARROW_SCHEMA, arrowSchema(fb), 0);
+	uint64_t const batch = sizeof(magic) + arrowFrame(&out, fb);
+
+	fbReset(fb);
+	arrowMessage(fb, ARROW_RECORD_BATCH, arrowBatch(fb, numel, starts, lengths), body);
+	uint64_t const meta = arrowFrame(&out, fb);
+
+	arrowText(&out, table, arrowCode);
+	arrowText(&out, table, arrowInfo);
+	arrowColumn(&out, table->_size_.begin(), numel);
+	arrowAvail(&out, table);
+	arrowColumn(&out, table->_cost_.begin(), numel);
+	arrowColumn(&out, table->_sale_.begin(), numel);
+	arrowColumn(&out, table->_count_.begin(), numel);
+	arrowText(&out, table, arrowKind);
+	arrowDerived(&out, table, false);
+	arrowDerived(&out, table, true);
+
+	// end of stream marker, then the footer, its size and the magic again
+	uint8_t tail[8];
+	arrowPut(&tail[0], 0xffffffff, sizeof(uint32_t));
+	arrowPut(&tail[4], 0, sizeof(uint32_t));
+	out.bytes(tail, sizeof(tail));
+	fbReset(fb);
+	size_t const footer = arrowFooter(fb, batch, meta, body);
+	out.bytes(fb->data + fb->head, footer);
+	arrowPut(&tail[0], footer, sizeof(uint32_t));
+	out.bytes(tail, sizeof(uint32_t));
+	out.bytes(magic, sizeof(ARROW_MAGIC) - 1);
+
+	if (out.flush() != 0 || fsync(fd) == -1) {
+		int const err = (out._error_)? out._error_ : errno;
+		close(fd);
+		unlink(temp);
+		arrowErr("arrow", temp, strerror(err));
+	}
+
+	if (close(fd) == -1 || rename(temp, path) == -1) {
+		int const err = errno;
+		unlink(temp);
+		arrowErr("arrow", path, strerror(err));
+	}
+
+	out._buffer_ = (char*) Util_Free(out._buffer_);
+	fb = (fbuilder_t*) Util_Free(fb);
+	temp = (char*) Util_Free(temp);
+}
+
+static void journalErr (const char *fname, const char *path, const char *msg)
+{
+	fprintf(stderr, "%s: %s: %s\n", fname, path, msg);
+	cleanup();
+	exit(EXIT_FAILURE);
+}
+
+static uint32_t recordCheck (const record_t *record)
+{
+	const char *data = (const char*) record;
+	size_t const skip = offsetof(record_t, lsn);
+	return (uint32_t) checksum(data + skip, record->bytes - skip, HASH);
+}
+
+Journal::Journal (void) : _window_(JOURNAL_WINDOW_MS)
+{
+	return;
+}
+
+// writes and syncs the buffer that is not taking records once per window
+void Journal::commit ()
+{
+	std::unique_lock<std::mutex> lock(this->_lock_);
+	while (true) {
+		this->_wake_.wait_for(lock, this->_window_, [this] {
+			return (this->_stop_ || this->_full_);
+		});
+
+		if (!this->_used_) {
+			if (this->_stop_) {
+				break;
 			}
-			memset(*_temp_, 0, MAX_BUFFER_SIZE);
-			_sz_ = MAX_BUFFER_SIZE;
-			printf("%s", prompt);
+			continue;
+		}
 
+		char *buffer = this->_buffer_[this->_active_];
+		size_t const used = this->_used_;
+		uint64_t const lsn = this->_lsn_;
+		this->_active_ ^= 1;
+		this->_used_ = 0;
+		this->_full_ = false;
+		this->_done_.notify_all();
+
+		lock.unlock();
+		struct iovec iov = {buffer, used};
+		int err = 0;
+		if (writeAll(this->_fd_, &iov, 1) != 0 || fdatasync(this->_fd_) == -1) {
+			err = errno;
+		}
+		lock.lock();
+
+		if (err) {
+			this->_error_ = err;
 		} else {
+			this->_durable_ = lsn;
+			this->_size_ += used;
+		}
+		this->_done_.notify_all();
+	}
+}
 
-			text = *_temp_ ;
-			skipWhiteSpace(&text);
-			char const c = *text ;
-			if (c == 'y' || c == 'Y' || c == 'n' || c == 'N'){
-				invalid = false;
-			} else {
-				invalid = true;
-			}
+int Journal::open (const char *path, uint64_t const lsn, size_t const size, long const window)
+{
+	int rc = 0;
+	this->_fd_ = ::open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (this->_fd_ == -1) {
+		rc = -1;
+		return rc;
+	}
 
-			if (invalid) {
-				printf("Please input N/Y\n");
-				printf("%s", prompt);
-			}
+	this->_buffer_[0] = (char*) Util_Malloc(JOURNAL_BUFFER_SIZE, M_BUFFER);
+	this->_buffer_[1] = (char*) Util_Malloc(JOURNAL_BUFFER_SIZE, M_BUFFER);
+	if (!this->_buffer_[0] || !this->_buffer_[1]) {
+		::close(this->_fd_);
+		this->_fd_ = -1;
+		rc = -1;
+		return rc;
+	}
+
+	this->_size_ = size;
+	if (!size) {
+		journal_t header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+		header.version = JOURNAL_VERSION;
+		header.endian = SNAPSHOT_ENDIAN;
+		struct iovec iov = {&header, sizeof(header)};
+		if (writeAll(this->_fd_, &iov, 1) != 0 || fsync(this->_fd_) == -1) {
+			::close(this->_fd_);
+			this->_fd_ = -1;
+			rc = -1;
+			return rc;
 		}
+		this->_size_ = sizeof(header);
+	}
 
-	} while (chars == -1 || invalid);
+	this->_lsn_ = lsn;
+	this->_durable_ = lsn;
+	this->_window_ = std::chrono::milliseconds(window);
+	this->_committer_ = std::thread(&Journal::commit, this);
+	return rc;
+}
 
-	_avail_ = *text;
-	if (_avail_ == 'y') {
-		_avail_ = 'Y';
+// copies the record and its strings into the active buffer, waits for the committer if the
+// buffer is full
+uint64_t Journal::push (record_t *record,
+			const char *code,
+			size_t const code_len,
+			const char *info,
+			size_t const info_len)
+{
+	size_t const bytes = sizeof(record_t) + code_len + info_len;
+	std::unique_lock<std::mutex> lock(this->_lock_);
+	while (!this->_error_ && (this->_used_ + bytes) > JOURNAL_BUFFER_SIZE) {
+		this->_full_ = true;
+		this->_wake_.notify_one();
+		this->_done_.wait(lock);
 	}
 
-	if (_avail_ == 'n') {
-		_avail_ = 'N';
+	if (this->_error_) {
+		int const err = this->_error_;
+		lock.unlock();
+		journalErr("Journal::append", "journal", strerror(err));
 	}
+
+	record->bytes = bytes;
+	record->lsn = this->_lsn_ + 1;
+	record->code = code_len;
+	record->info = info_len;
+
+	char *dst = this->_buffer_[this->_active_] + this->_used_;
+	memcpy(dst, record, sizeof(*record));
+	memcpy(dst + sizeof(*record), code, code_len);
+	memcpy(dst + sizeof(*record) + code_len, info, info_len);
+	((record_t*) dst)->check = recordCheck((const record_t*) dst);
+
+	this->_used_ += bytes;
+	this->_lsn_ = record->lsn;
+	return record->lsn;
 }
 
-void gnew (void)
+uint64_t Journal::append (const char *code,
+			  const char *info,
+			  char const avail,
+			  double const size,
+			  double const cost,
+			  double const sale,
+			  double const count,
+			  kind_t const kind,
+			  char const op)
 {
-	char *text = NULL;
-	ssize_t chars = 0;
-	bool invalid = true;
-	memset(*_temp_, 0, _sz_);
-	char prompt[] = "Input N/Y if there is (no) other new shoe to add:";
-	printf("\n");
-	printf("%s", prompt);
-	do {
-		errno = 0;
-		chars = getline(_temp_, &_sz_, stdin);
-		if (chars == -1) {
+	record_t record;
+	memset(&record, 0, sizeof(record));
+	record.size = size;
+	record.cost = cost;
+	record.sale = sale;
+	record.count = count;
+	record.kind = kind;
+	record.avail = avail;
+	record.op = op;
+	return this->push(&record, code, strlen(code), info, strlen(info));
+}
 
-			if (errno) {
-				fprintf(stderr, "gnew: %s\n", strerror(errno));
-				cleanup();
-				exit(EXIT_FAILURE);
-			}
+// logs a repricing of the costs in [lo, hi], the pricing goes along so that the replay does not
+// depend on the pricing of the session that replays it
+uint64_t Journal::reprice (const pricing_t *pricing, double const lo, double const hi)
+{
+	record_t record;
+	memset(&record, 0, sizeof(record));
+	record.cost = lo;
+	record.sale = hi;
+	record.op = RECORD_REPRICE;
+	return this->push(&record, "", 0, (const char*) pricing, sizeof(*pricing));
+}
 
-			clearerr(stdin);
-			printf("\nPlease input N/Y\n");
-			printf("%s", prompt);
+// waits until the record is on disk
+void Journal::ack (uint64_t const lsn)
+{
+	std::unique_lock<std::mutex> lock(this->_lock_);
+	while (!this->_error_ && this->_durable_ < lsn) {
+		this->_done_.wait(lock);
+	}
 
-		} else if (chars > MAX_STRING_LEN) {
+	if (this->_error_) {
+		int const err = this->_error_;
+		lock.unlock();
+		journalErr("Journal::ack", "journal", strerror(err));
+	}
+}
 
-			invalid = true;
-			char msg[] = "The input exceeds the max number of chars %d\n";
-			printf(msg, MAX_STRING_LEN);
-			printf("Please input just N/Y\n");
-			*_temp_ = (char*) realloc(*_temp_, MAX_BUFFER_SIZE);
-			if (!*_temp_) {
-				fprintf(stderr, "gnew: %s\n", strerror(errno));
-				cleanup();
-				exit(EXIT_FAILURE);
-			}
-			memset(*_temp_, 0, MAX_BUFFER_SIZE);
-			_sz_ = MAX_BUFFER_SIZE;
-			printf("%s", prompt);
+size_t Journal::bytes ()
+{
+	std::lock_guard<std::mutex> lock(this->_lock_);
+	return (this->_size_ + this->_used_);
+}
 
-		} else {
+// drops the records once a snapshot holds them, the caller acknowledges the records beforehand
+int Journal::truncate ()
+{
+	std::lock_guard<std::mutex> lock(this->_lock_);
+	int rc = 0;
+	if (ftruncate(this->_fd_, sizeof(journal_t)) == -1 || fsync(this->_fd_) == -1) {
+		rc = -1;
+		return rc;
+	}
 
-			text = *_temp_ ;
-			skipWhiteSpace(&text);
-			char const c = *text ;
-			if (c == 'y' || c == 'Y' || c == 'n' || c == 'N'){
-				invalid = false;
-			} else {
-				invalid = true;
+	this->_size_ = sizeof(journal_t);
+	return rc;
+}
+
+void Journal::close ()
+{
+	if (this->_committer_.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(this->_lock_);
+			this->_stop_ = true;
+		}
+		this->_wake_.notify_one();
+		this->_committer_.join();
+	}
+
+	if (this->_fd_ != -1) {
+		::close(this->_fd_);
+		this->_fd_ = -1;
+	}
+}
+
+void *Journal::operator new (size_t size)
+{
+	return Util_PoolMalloc(size);
+}
+
+void Journal::operator delete (void *p)
+{
+	p = Util_Free(p);
+}
+
+// applies the records past the snapshot and discards a torn tail, opens the journal for appends
+void replay (ItemTable *table, const char *path)
+{
+	size_t size = 0;
+	uint64_t lsn = table->_lsn_;
+	int const fd = open(path, O_RDWR);
+	if (fd == -1 && errno != ENOENT) {
+		journalErr("replay", path, strerror(errno));
+	}
+
+	if (fd != -1) {
+		struct stat st;
+		if (fstat(fd, &st) == -1) {
+			int const err = errno;
+			close(fd);
+			journalErr("replay", path, strerror(err));
+		}
+
+		size = st.st_size;
+	}
+
+	if (size) {
+		void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED) {
+			int const err = errno;
+			close(fd);
+			journalErr("replay", path, strerror(err));
+		}
+
+		const char *base = (const char*) p;
+		const journal_t *header = (const journal_t*) p;
+		if (size < sizeof(journal_t) ||
+		    memcmp(header->magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) ||
+		    header->version != JOURNAL_VERSION ||
+		    header->endian != SNAPSHOT_ENDIAN) {
+			munmap(p, size);
+			close(fd);
+			journalErr("replay", path, "not a journal");
+		}
+
+		size_t applied = 0;
+		size_t offset = sizeof(journal_t);
+		while ((size - offset) >= sizeof(record_t)) {
+			record_t record;
+			memcpy(&record, base + offset, sizeof(record));
+			size_t const bytes = record.bytes;
+			if (bytes < sizeof(record_t) ||
+			    bytes > (size - offset) ||
+			    bytes != sizeof(record_t) + record.code + record.info ||
+			    record.code > MAX_STRING_LEN ||
+			    record.info > MAX_STRING_LEN ||
+			    record.check != recordCheck((const record_t*) (base + offset))) {
+				break;
 			}
 
-			if (invalid) {
-				printf("Please input N/Y\n");
-				printf("%s", prompt);
+			if (record.lsn > table->_lsn_) {
+				const char *code = base + offset + sizeof(record_t);
+				const char *info = code + record.code;
+				memcpy(*_code_, code, record.code);
+				(*_code_)[record.code] = 0;
+				memcpy(*_info_, info, record.info);
+				(*_info_)[record.info] = 0;
+
+				size_t row = NPOS;
+				if (record.op == RECORD_REPRICE) {
+					pricing_t pricing;
+					memset(&pricing, 0, sizeof(pricing));
+					if (record.info == sizeof(pricing)) {
+						memcpy(&pricing, info, sizeof(pricing));
+					}
+
+					if (record.code ||
+					    record.info != sizeof(pricing) ||
+					    pricing.tiers == 0 ||
+					    pricing.tiers > KINDS) {
+						munmap(p, size);
+						close(fd);
+						journalErr("replay", path, "corrupted repricing record");
+					}
+
+					repriceRows(table, &pricing, record.cost, record.sale);
+				} else if (record.op == RECORD_ERASE) {
+					row = table->find(*_code_);
+					if (row != NPOS && table->erase(row) != 0) {
+						munmap(p, size);
+						close(fd);
+						journalErr("replay", path, "error");
+					}
+				} else if (table->upsert(*_code_,
+						  *_info_,
+						  record.avail,
+						  record.size,
+						  record.cost,
+						  record.sale,
+						  record.count,
+						  (kind_t) record.kind,
+						  &row) != 0) {
+					munmap(p, size);
+					close(fd);
+					journalErr("replay", path, "error");
+				}
+
+				table->_lsn_ = record.lsn;
+				++applied;
 			}
+
+			lsn = record.lsn;
+			offset += bytes;
 		}
 
-	} while (chars == -1 || invalid);
+		munmap(p, size);
+		if (offset != size) {
+			fprintf(stderr, "replay: %s: discards a torn tail of %zu bytes\n",
+				path,
+				size - offset);
+			if (ftruncate(fd, offset) == -1) {
+				int const err = errno;
+				close(fd);
+				journalErr("replay", path, strerror(err));
+			}
+		}
 
-	char const c = *text;
-	if (c == 'y' || c == 'Y') {
-		_new_ = true;
-	} else {
-		_new_ = false;
+		size = offset;
+		printf("REPLAYED ITEMS: %zu\n", applied);
 	}
 
-	printf("\n");
+	if (fd != -1) {
+		close(fd);
+	}
+
+	if (lsn < table->_lsn_) {
+		lsn = table->_lsn_;
+	}
+
+	_journal_ = new Journal();
+	if (!_journal_ || _journal_->open(path, lsn, size, _window_) != 0) {
+		int const err = errno;
+		_journal_ = NULL;
+		journalErr("replay", path, strerror(err));
+	}
+
+	table->_lsn_ = lsn;
 }
 
-void gcost (void)
+// folds the journal into the snapshot so that the journal does not grow without bound
+void compact (ItemTable *table)
 {
-	char prompt[] = "Input the shoe cost:";
-	char msg[] = "Please input a valid shoe cost value";
-	validData("gcost", prompt, callback, msg);
-	_cost_ = _number_ ;
+	_journal_->ack(table->_lsn_);
+	save(table, _snapshot_);
+	if (_journal_->truncate() != 0) {
+		journalErr("compact", _journal_path_, strerror(errno));
+	}
 }
 
-void gprofit (void)
+static void diffOpen (dside_t *side, const char *path)
 {
-	switch (_kind_) {
-		case A:
-			_profit_ = 0.50;
-			break;
-		case B:
-			_profit_ = 0.40;
-			break;
-		default:
-			_profit_ = 0.30;
+	side->map = snapshotMap("diff", path, PROT_READ, &side->size);
+	if (!side->map) {
+		snapshotErr("diff", path, strerror(ENOENT));
 	}
+
+	// both files are read whole, the read-ahead saves most of the page faults
+	madvise(side->map, side->size, MADV_WILLNEED);
+	const char *base = (const char*) side->map;
+	const snapshot_t *header = (const snapshot_t*) side->map;
+	side->numel = header->numel;
+	side->cost = (const double*) (base + header->offset[0]);
+	side->sale = (const double*) (base + header->offset[1]);
+	side->count = (const double*) (base + header->offset[2]);
+	side->code = (const size_t*) (base + header->offset[6]);
+	side->heap = base + header->offset[8];
+	side->bytes = header->heap;
+	side->path = path;
 }
 
-void uprofit (void)
+// reference code of the row, its offset is bounded by the heap that ends in a NUL
+static const char *diffCode (const dside_t *side, size_t const i)
 {
-	if (_kind_ == A) {
-		_profit_ = 0.50;
-	} else if (_kind_ == B) {
-		_profit_ = 0.40;
-	} else {
-		_profit_ = 0.30;
+	size_t const offset = side->code[i];
+	if (offset >= side->bytes) {
+		snapshotErr("diff", side->path, "string offset out of bounds");
 	}
+
+	return side->heap + offset;
 }
 
-void gsale (void)
+static void diffItem (const char *what, const dside_t *side, size_t const i)
 {
-	double const cost = _cost_ ;
-	double const profit = _profit_ ;
-	double const sale = cost * (profit + 1.0);
-	_sale_ = sale;
+	_out_->text(what).text(": ").text(diffCode(side, i));
+	_out_->text(" COUNT: ").fixed(side->count[i], 0);
+	_out_->text(" COST: ").fixed(side->cost[i], 2);
+	_out_->text(" SALE: ").fixed(side->sale[i], 2).put('\n');
 }
 
-void gcount (void)
+static void diffField (const char *label, double const from, double const to, int const prec)
 {
-	char prompt[] = "Input the shoe count:";
-	void (*cb) (bool*) = callback_cnt;
-	char msg[] = "Please input a valid shoe count value";
-	validData("gcount", prompt, cb, msg);
-	_count_ = _number_ ;
+	if (from != to) {
+		_out_->text(label).fixed(from, prec).text(" -> ").fixed(to, prec);
+	}
 }
 
-Item *gitem (void)
+/*
+
+compares two snapshots by reference code with a hash join: the old one is indexed by code, the
+rows of the new one are looked up in order and are reported as added or changed (count, cost or
+sale) as they are met, and the rows of the old one that no row matched are reported as removed
+at the end. The memory is the index of the old one and a bit per old row, the columns are read
+from the mappings of the files. The inserts and the probes are issued in batches of DIFF_BATCH
+rows whose slots are prefetched first, so that the cache misses of the index overlap.
+
+*/
+
+void diff (const char *from, const char *to)
 {
-	char *code = Util_CopyString(*_code_);
-	if (!code) {
-		Util_Clear();
-		fprintf(stderr, "gitem: error\n");
+	dside_t old;
+	dside_t cur;
+	diffOpen(&old, from);
+	diffOpen(&cur, to);
+
+	CodeIndex *index = new CodeIndex();
+	if (!index || index->reserve(old.numel) != 0) {
+		fprintf(stderr, "diff: error\n");
+		cleanup();
 		exit(EXIT_FAILURE);
 	}
 
-	char *info = Util_CopyString(*_info_);
-	if (!info) {
-		Util_Clear();
-		fprintf(stderr, "gitem: error\n");
+	size_t hashes[DIFF_BATCH];
+	for (size_t first = 0; first < old.numel; first += DIFF_BATCH) {
+		size_t const last = (first + DIFF_BATCH < old.numel)? first + DIFF_BATCH : old.numel;
+		for (size_t i = first; i != last; ++i) {
+			size_t const hash = hashCode(diffCode(&old, i));
+			hashes[i - first] = hash;
+			__builtin_prefetch(&index->_slots_[hash & index->_mask_], 1);
+		}
+
+		for (size_t i = first; i != last; ++i) {
+			if (index->insert(hashes[i - first], i) != 0) {
+				fprintf(stderr, "diff: error\n");
+				cleanup();
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+
+	size_t const words = (old.numel + 63) / 64;
+	uint64_t *matched = (uint64_t*) Util_Malloc((words + 1) * sizeof(uint64_t), M_BUFFER);
+	if (!matched) {
+		fprintf(stderr, "diff: %s\n", strerror(errno));
+		cleanup();
 		exit(EXIT_FAILURE);
 	}
+	memset(matched, 0, (words + 1) * sizeof(uint64_t));
+
+	size_t added = 0;
+	size_t changed = 0;
+	for (size_t first = 0; first < cur.numel; first += DIFF_BATCH) {
+		size_t const last = (first + DIFF_BATCH < cur.numel)? first + DIFF_BATCH : cur.numel;
+		for (size_t i = first; i != last; ++i) {
+			size_t const hash = hashCode(diffCode(&cur, i));
+			hashes[i - first] = hash;
+			__builtin_prefetch(&index->_slots_[hash & index->_mask_]);
+		}
 
-	memset(*_temp_, 0, MAX_BUFFER_SIZE);
-	**_temp_ = _avail_ ;
-	char *avail = Util_CopyString(*_temp_);
-	if (!avail) {
-		Util_Clear();
-		fprintf(stderr, "gitem: error\n");
-		exit(EXIT_FAILURE);
+		for (size_t i = first; i != last; ++i) {
+			const char *code = diffCode(&cur, i);
+			size_t const row = index->find(code, hashes[i - first], old.heap, old.code);
+			if (row == NPOS) {
+				diffItem("ADDED", &cur, i);
+				++added;
+				continue;
+			}
+
+			matched[row / 64] |= ((uint64_t) 1) << (row % 64);
+			if (old.count[row] == cur.count[i] &&
+			    old.cost[row] == cur.cost[i] &&
+			    old.sale[row] == cur.sale[i]) {
+				continue;
+			}
+
+			_out_->text("CHANGED: ").text(code);
+			diffField(" COUNT: ", old.count[row], cur.count[i], 0);
+			diffField(" COST: ", old.cost[row], cur.cost[i], 2);
+			diffField(" SALE: ", old.sale[row], cur.sale[i], 2);
+			_out_->put('\n');
+			++changed;
+		}
 	}
 
-	double *size = Util_CopyNumber(&_size_);
-	if (!size) {
-		Util_Clear();
-		fprintf(stderr, "gitem: error\n");
-		exit(EXIT_FAILURE);
+	size_t removed = 0;
+	for (size_t w = 0; w != words; ++w) {
+		uint64_t missing = ~matched[w];
+		while (missing) {
+			size_t const row = 64 * w + __builtin_ctzll(missing);
+			missing &= (missing - 1);
+			if (row >= old.numel) {
+				break;
+			}
+			diffItem("REMOVED", &old, row);
+			++removed;
+		}
 	}
 
-	double *cost = Util_CopyNumber(&_cost_);
-	if (!cost) {
-		Util_Clear();
-		fprintf(stderr, "gitem: error\n");
+	_out_->text("\nADDED ITEMS: ").fixed(added, 0).put('\n');
+	_out_->text("REMOVED ITEMS: ").fixed(removed, 0).put('\n');
+	_out_->text("CHANGED ITEMS: ").fixed(changed, 0).put('\n');
+	_out_->text("UNCHANGED ITEMS: ").fixed(cur.numel - added - changed, 0).put('\n');
+	flush();
+
+	matched = (uint64_t*) Util_Free(matched);
+	index->_slots_ = (slot_t*) Util_Free(index->_slots_);
+	delete index;
+	munmap(old.map, old.size);
+	munmap(cur.map, cur.size);
+}
+
+ItemTable *start (void)
+{
+	ItemTable *table = new ItemTable();
+	if (!table) {
+		fprintf(stderr, "start: error\n");
+		cleanup();
 		exit(EXIT_FAILURE);
 	}
 
-	double *sale = Util_CopyNumber(&_sale_);
-	if (!sale) {
-		Util_Clear();
-		fprintf(stderr, "gitem: error\n");
-		exit(EXIT_FAILURE);
+	if (_snapshot_) {
+		load(table, _snapshot_);
 	}
 
-	double *count = Util_CopyNumber(&_count_);
-	if (!count) {
-		Util_Clear();
-		fprintf(stderr, "gitem: error\n");
-		exit(EXIT_FAILURE);
+	if (_journal_path_) {
+		replay(table, _journal_path_);
 	}
 
-	Kind *kind = new Kind(_kind_);
-	if (!kind) {
-		Util_Clear();
-		fprintf(stderr, "gitem: error\n");
-		exit(EXIT_FAILURE);
+	if (_delete_) {
+		erase(table, _delete_);
 	}
 
-	Item *item = new Item(code, info, avail, size, cost, sale, count, kind);
-	if (!item) {
-		Util_Clear();
-		fprintf(stderr, "gitem: error\n");
-		exit(EXIT_FAILURE);
+	if (_repricing_) {
+		reprice(table, _reprice_lo_, _reprice_hi_);
 	}
 
-	return item;
+	return table;
 }
 
-void gkind (void)
+void finish (ItemTable *table)
 {
-	if (_cost_ > 60.0e3) {
-		_kind_ = C;
-	} else if (_cost_ > 30.0e3 && _cost_ <= 60.0e3) {
-		_kind_ = B;
-	} else {
-		_kind_ = A;
+	aggregate(table);
+	report(table);
+	if (_export_) {
+		arrow(table, _export_);
+	}
+	if (_snapshot_ && _journal_) {
+		compact(table);
+	} else if (_snapshot_) {
+		save(table, _snapshot_);
 	}
 }
 
-void header (void)
+static uint64_t benchNext (uint64_t *state)
 {
-	printf("THE SHOE INPUT DATA IS THE FOLLOWING\n\n");
+	*state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (*state >> 17);
 }
 
-void code (void)
+// uniform in [0, 1)
+static double benchUniform (uint64_t *state)
 {
-	printf("REFERENCE: %s\n", *_code_);
+	return (double) (benchNext(state) & ((((uint64_t) 1) << 47) - 1)) * 0x1.0p-47;
 }
 
-void info (void)
+static void benchErr (const char *path)
 {
-	printf("DESCRIPTION: %s\n", *_info_);
+	fprintf(stderr, "bench: %s: %s\n", path, strerror(errno));
+	cleanup();
+	exit(EXIT_FAILURE);
 }
 
-void size (void)
-{
-	printf("SIZE: %.1f\n", _size_);
-}
+/*
 
-void avail (void)
+writes the synthetic inventory, the rows are unique and all of them are accepted by the import:
+codes of 6 to 13 chars, descriptions of one to eight words (some quoted with an embedded comma),
+half sizes between 4 and 14, and costs that put about 55%, 30% and 15% of the items in the bands
+A, B and C, log-uniform within A and C
+
+*/
+static size_t benchGenerate (const char *path, size_t const numel, uint64_t const seed)
 {
-	printf("AVAILABLE: %c\n", _avail_);
+	static const char letters[] = "ABCDEFGHJKLMNPQRSTUVWXYZ";
+	static const char *words[] = {
+		"running", "trail", "leather", "canvas", "suede", "classic", "sport", "high",
+		"low", "top", "boot", "sneaker", "loafer", "sandal", "slip-on", "oxford",
+		"derby", "mule", "clog", "wedge", "red", "black", "white", "navy",
+		"grey", "brown", "kids", "mens", "womens", "waterproof", "lightweight", "wide"
+	};
+
+	int const fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		benchErr(path);
+	}
+
+	Writer *csv = new Writer();
+	if (!csv || csv->open(fd, WRITER_BUFFER_SIZE) != 0) {
+		close(fd);
+		benchErr(path);
+	}
+
+	uint64_t state = seed ^ HASH;
+	csv->text("code,description,size,available,cost,count\n");
+	for (size_t i = 0; i != numel; ++i) {
+		char code[32];
+		char *dst = code;
+		size_t const prefix = 2 + benchNext(&state) % 3;
+		for (size_t j = 0; j != prefix; ++j) {
+			*dst++ = letters[benchNext(&state) % (sizeof(letters) - 1)];
+		}
+
+		// the serial keeps the codes unique
+		dst += sprintf(dst, "%04zu", i);
+		if (benchNext(&state) % 4 == 0) {
+			*dst++ = '-';
+			*dst++ = letters[benchNext(&state) % (sizeof(letters) - 1)];
+		}
+		*dst = 0;
+
+		bool const quoted = (benchNext(&state) % 10 == 0);
+		size_t const nwords = 1 + benchNext(&state) % 8;
+		csv->text(code).put(',');
+		if (quoted) {
+			csv->put('"');
+		}
+
+		for (size_t j = 0; j != nwords; ++j) {
+			if (j) {
+				csv->put((quoted && j == 1)? ',' : ' ');
+				if (quoted && j == 1) {
+					csv->put(' ');
+				}
+			}
+			csv->text(words[benchNext(&state) % (sizeof(words) / sizeof(*words))]);
+		}
+
+		if (quoted) {
+			csv->put('"');
+		}
+
+		double const size = 4.0 + 0.5 * (double) (benchNext(&state) % 21);
+		char const avail = (benchNext(&state) % 100 < 85)? 'Y' : 'N';
+		double const u = benchUniform(&state);
+		double const v = benchUniform(&state);
+		double cost = 0;
+		if (u < 0.55) {
+			cost = 500.0 * pow(60.0, v);
+		} else if (u < 0.85) {
+			cost = 30.0e3 + 30.0e3 * v;
+		} else {
+			cost = 60.0e3 * pow(4.0, v);
+		}
+
+		// keeps the costs at the edges of the bands where the import puts them
+		cost = floor(cost * 100.0) / 100.0;
+		if (u >= 0.55 && u < 0.85 && cost <= 30.0e3) {
+			cost = 30.0e3 + 0.01;
+		}
+
+		if (u >= 0.85 && cost <= 60.0e3) {
+			cost = 60.0e3 + 0.01;
+		}
+
+		double const count = (double) (1 + benchNext(&state) % 250);
+		csv->put(',').fixed(size, 1).put(',').put(avail).put(',');
+		csv->fixed(cost, 2).put(',').fixed(count, 0).put('\n');
+	}
+
+	int rc = csv->flush();
+	if (fsync(fd) == -1) {
+		rc = -1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		rc = -1;
+	}
+
+	close(fd);
+	if (rc != 0) {
+		benchErr(path);
+	}
+
+	return st.st_size;
 }
 
-void cost (void)
+static double benchSeconds (std::chrono::steady_clock::time_point const t0,
+			    std::chrono::steady_clock::time_point const t1)
 {
-	printf("COST: %.2f\n", _cost_);
+	return std::chrono::duration<double>(t1 - t0).count();
 }
 
-void sale (void)
+// best of BENCH_REPEAT runs of the idempotent scenarios
+static double benchBest (void (*scenario)(ItemTable*), ItemTable *table)
 {
-	printf("SALE: %.2f\n", _sale_);
+	double best = HUGE_VAL;
+	for (size_t i = 0; i != BENCH_REPEAT; ++i) {
+		auto t0 = std::chrono::steady_clock::now();
+		scenario(table);
+		auto t1 = std::chrono::steady_clock::now();
+		double const seconds = benchSeconds(t0, t1);
+		best = (seconds < best)? seconds : best;
+	}
+
+	return best;
 }
 
-void count (void)
+static void benchAggregate (ItemTable *table)
 {
-	printf("COUNT: %.0f\n", _count_);
+	aggregate(table);
+	fflush(stdout);
 }
 
-void kind (void)
+// classifies the costs of the table, the sum of the tiers keeps the loop from being dropped
+static void benchClassify (ItemTable *table)
 {
-	char k = ((kind_t) 0);
-	switch (_kind_) {
-		case A:
-			k = 'A';
-			break;
-		case B:
-			k = 'B';
-			break;
-		default:
-			k = 'C';
+	static volatile size_t sink = 0;
+	const double *costs = table->_cost_.begin();
+	size_t const numel = table->numel();
+	size_t sum = 0;
+	for (size_t i = 0; i != numel; ++i) {
+		sum += band(costs[i]);
 	}
 
-	printf("KIND: %c\n", k);
+	sink = sink + sum;
 }
 
-void total (void)
+static void benchReport (ItemTable *table)
 {
-	double const cost = _cost_ ;
-	double const sale = _sale_ ;
-	double const units = _count_ ;
-	double const total_cost = units * cost;
-	double const total_sale = units * sale;
-	printf("TOTAL COST: %.2f\n", total_cost);
-	printf("TOTAL PROFIT OF %.0f UNITS: %.2f\n", units, total_sale);
+	report(table);
+	flush();
 }
 
-void profit (void)
+static void benchScenario (Writer *json, const char *name, double const seconds, size_t const numel)
 {
-	double const cost = _cost_ ;
-	double const sale = _sale_ ;
-	double const units = _count_ ;
-	double const profit = (sale - cost);
-	double const total_cost = units * cost;
-	double const net_profit = units * (sale - cost);
-	printf("PROFIT PER UNIT: %.2f\n", profit);
-	printf("NET PROFIT: %.2f\n", net_profit);
-	printf("PROFIT PERCENTAGE: %.2f\n", (net_profit / total_cost) * 100);
+	json->text("    {\"name\": \"").text(name).text("\", ");
+	json->text("\"seconds\": ").fixed(seconds, 6).text(", ");
+	json->text("\"items_per_sec\": ").fixed(numel / seconds, 0).text(", ");
+	json->text("\"ns_per_item\": ").fixed(1.0e9 * seconds / numel, 2).text("}");
 }
 
-void aggregate (Stack *stack)
+// times the two-pass parser (is_numeric() and toNumber()) against parseNumber() on prices
+static void benchParse (Writer *json)
 {
-	double profit = 0;
-	double expenses = 0;
-	for (void **it = stack->begin(); it != stack->end(); ++it) {
-		Item *item = (Item*) *it;
-		double const units = *item->count;
-		double const sale = *item->sale;
-		double const cost = *item->cost;
-		profit += units * (sale - cost);
-		expenses += units * cost;
+	size_t const numel = BENCH_NUMBERS;
+	size_t const width = 16;
+	char *text = (char*) Util_Malloc(numel * width);
+	if (!text) {
+		fprintf(stderr, "bench: %s\n", strerror(errno));
+		cleanup();
+		exit(EXIT_FAILURE);
 	}
 
-	printf("AGGREGATE PROFIT: %.2f\n", profit);
-	printf("AGGREGATE COST: %.2f\n", expenses);
-	printf("PROFIT PERCENTAGE: %.2f\n", (profit / expenses) * 100);
-}
+	uint64_t state = HASH;
+	for (size_t i = 0; i != numel; ++i) {
+		state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+		unsigned const units = (unsigned) ((state >> 33) % 1000000);
+		unsigned const cents = (unsigned) ((state >> 17) % 100);
+		snprintf(&text[i * width], width, "%u.%02u\n", units, cents);
+	}
 
-void greet (void)
-{
-	printf("\nThank you for providing the information\n");
+	double strtod_sum = 0;
+	size_t mismatch = 0;
+	auto t0 = std::chrono::steady_clock::now();
+	for (size_t i = 0; i != numel; ++i) {
+		char *txt[] = {&text[i * width]};
+		if (is_numeric(txt) && !toNumber(txt)) {
+			strtod_sum += _number_;
+		}
+	}
+	auto t1 = std::chrono::steady_clock::now();
+
+	double parse_sum = 0;
+	for (size_t i = 0; i != numel; ++i) {
+		if (!parseNumber(&text[i * width], &_number_)) {
+			parse_sum += _number_;
+		}
+	}
+	auto t2 = std::chrono::steady_clock::now();
+
+	for (size_t i = 0; i != numel; ++i) {
+		char *txt[] = {&text[i * width]};
+		bool const invalid = (!is_numeric(txt) || toNumber(txt));
+		double const number = _number_;
+		if (invalid != parseNumber(&text[i * width], &_number_) || (!invalid && number != _number_)) {
+			++mismatch;
+		}
+	}
+
+	double const strtod_ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / numel;
+	double const parse_ns = std::chrono::duration<double, std::nano>(t2 - t1).count() / numel;
+	json->text("  \"parse\": {\"numbers\": ").fixed(numel, 0);
+	json->text(", \"strtod_ns\": ").fixed(strtod_ns, 2);
+	json->text(", \"single_pass_ns\": ").fixed(parse_ns, 2);
+	json->text(", \"speedup\": ").fixed(strtod_ns / parse_ns, 2);
+	json->text(", \"mismatches\": ").fixed(mismatch + (strtod_sum != parse_sum), 0).text("},\n");
+	text = (char*) Util_Free(text);
 }
 
-void cleanup (void)
+/*
+
+runs the end-to-end scenarios on a synthetic inventory of _bench_items_ items and writes the
+results to stdout as JSON, the output of the scenarios themselves goes to /dev/null. The options
+that the scenarios set are restored once they are done, and the temporary files are removed on
+every exit since cleanup() removes them.
+
+*/
+void bench (void)
 {
+	size_t const numel = _bench_items_;
+	const char *dir = getenv("TMPDIR");
+	char *csv = _bench_csv_;
+	char *snap = _bench_snap_;
+	snprintf(csv, sizeof(_bench_csv_), "%s/inventory-bench-%d.csv", (dir)? dir : "/tmp", (int) getpid());
+	snprintf(snap, sizeof(_bench_snap_), "%s/inventory-bench-%d.snapshot", (dir)? dir : "/tmp", (int) getpid());
+	bool const verify = _verify_;
+	const char *find = _find_;
+	bool const range = _range_;
+	double const range_lo = _range_lo_;
+	double const range_hi = _range_hi_;
+	size_t const top = _top_;
+	int const group = _group_;
+	size_t const csv_bytes = benchGenerate(csv, numel, _seed_);
+
+	fflush(stdout);
+	flush();
+	int const out = dup(STDOUT_FILENO);
+	int const null = open("/dev/null", O_WRONLY);
+	if (out == -1 || null == -1 || dup2(null, STDOUT_FILENO) == -1) {
+		benchErr("/dev/null");
+	}
+	close(null);
+
+	ItemTable *table = new ItemTable();
+	if (!table) {
+		fprintf(stderr, "bench: error\n");
+		cleanup();
+		exit(EXIT_FAILURE);
+	}
+
+	auto t0 = std::chrono::steady_clock::now();
+	import(csv, table);
+	fflush(stdout);
+	auto t1 = std::chrono::steady_clock::now();
+	double const ingest = benchSeconds(t0, t1);
+	if (table->numel() != numel) {
+		fprintf(stderr, "bench: imported %zu of %zu items\n", table->numel(), numel);
+		cleanup();
+		exit(EXIT_FAILURE);
+	}
+
+	m_stats_t stats;
+	size_t heap_bytes = 0;
+	size_t objects = 0;
+	Util_Totals(&stats, &heap_bytes, &objects);
+	size_t const table_bytes = table->bytes();
+
+	// verifies the running totals against a full scan of the table
+	_verify_ = true;
+	double const aggregate = benchBest(benchAggregate, table);
+
+	// the pricing in effect, then the tier kernel that a pricing file selects
+	double const classify = benchBest(benchClassify, table);
+	bool const builtin = _pricing_.builtin;
+	_pricing_.builtin = false;
+	double const classify_table = benchBest(benchClassify, table);
+	_pricing_.builtin = builtin;
+
+	Item item = table->row(numel / 2);
+	_find_ = item.code;
+	_range_ = true;
+	_range_lo_ = 30.0e3;
+	_range_hi_ = 60.0e3;
+	_top_ = 10;
+	_group_ = 2;
+	double const report = benchBest(benchReport, table);
+
+	t0 = std::chrono::steady_clock::now();
+	save(table, snap);
+	fflush(stdout);
+	t1 = std::chrono::steady_clock::now();
+	double const save = benchSeconds(t0, t1);
+
+	struct stat st;
+	if (stat(snap, &st) == -1) {
+		benchErr(snap);
+	}
+
+	ItemTable *copy = new ItemTable();
+	if (!copy) {
+		fprintf(stderr, "bench: error\n");
+		cleanup();
+		exit(EXIT_FAILURE);
+	}
+
+	t0 = std::chrono::steady_clock::now();
+	load(copy, snap);
+	if (copy->index() != 0 || copy->numel() != numel) {
+		fprintf(stderr, "bench: the snapshot does not round-trip\n");
+		cleanup();
+		exit(EXIT_FAILURE);
+	}
+	fflush(stdout);
+	t1 = std::chrono::steady_clock::now();
+	double const restore = benchSeconds(t0, t1);
+
+	flush();
+	_out_ = NULL;
+	t0 = std::chrono::steady_clock::now();
 	Util_Clear();
-}
+	t1 = std::chrono::steady_clock::now();
+	double const teardown = benchSeconds(t0, t1);
+
+	unlink(csv);
+	unlink(snap);
+	csv[0] = '\0';
+	snap[0] = '\0';
+	_verify_ = verify;
+	_find_ = find;
+	_range_ = range;
+	_range_lo_ = range_lo;
+	_range_hi_ = range_hi;
+	_top_ = top;
+	_group_ = group;
+	fflush(stdout);
+	if (dup2(out, STDOUT_FILENO) == -1) {
+		benchErr("stdout");
+	}
+	close(out);
 
-#if defined(__unix__) || defined(__linux__) || defined(__APPLE__)
-void clear ()
-{
-        system("clear");
-}
-#elif defined(_WIN32) || defined(_WIN64)
-void clear ()
-{
-        system("cls");
-}
-#else
-void clear ()
-{
-	return;
-}
-#endif
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
 
-#if defined(__unix__) || defined(__linux__) || defined(__APPLE__)
-void pause ()
-{
-        return;
-}
-#elif defined(_WIN32) || defined(_WIN64)
-void pause ()
-{
-        system("pause");
-}
-#else
-void pause ()
-{
-	return;
-}
-#endif
+	_out_ = new Writer();
+	if (!_out_ || _out_->open(STDOUT_FILENO, WRITER_BUFFER_SIZE) != 0) {
+		_out_ = NULL;
+		fprintf(stderr, "bench: %s\n", strerror(errno));
+		cleanup();
+		exit(EXIT_FAILURE);
+	}
 
-#if defined(SWITCH) && SWITCH
-void get (void)
-{
-	gcode();
-	ginfo();
-	gsize();
-	gavail();
-	gcost();
-	gkind();
-	gprofit();
-	gsale();
-	gcount();
-}
-#else
-void get (void)
-{
-	gcode();
-	ginfo();
-	gsize();
-	gavail();
-	gcost();
-	gkind();
-	uprofit();
-	gsale();
-	gcount();
+	Writer *json = _out_;
+	json->text("{\n  \"items\": ").fixed(numel, 0);
+	json->text(",\n  \"seed\": ").fixed(_seed_, 0);
+	json->text(",\n  \"threads\": ").fixed(workers(), 0);
+	json->text(",\n  \"simd\": \"").text(_simd_).text("\"");
+	json->text(",\n  \"tiers\": ").fixed(_pricing_.tiers, 0).text(",\n");
+	benchParse(json);
+	json->text("  \"scenarios\": [\n");
+	benchScenario(json, "ingest", ingest, numel);
+	json->text(",\n");
+	benchScenario(json, "aggregate", aggregate, numel);
+	json->text(",\n");
+	benchScenario(json, "classify", classify, numel);
+	json->text(",\n");
+	benchScenario(json, "classify_table", classify_table, numel);
+	json->text(",\n");
+	benchScenario(json, "report", report, numel);
+	json->text(",\n");
+	benchScenario(json, "snapshot_save", save, numel);
+	json->text(",\n");
+	benchScenario(json, "snapshot_load", restore, numel);
+	json->text(",\n");
+	benchScenario(json, "teardown", teardown, numel);
+	json->text("\n  ],\n");
+	json->text("  \"bytes_per_item\": {\"csv\": ").fixed((double) csv_bytes / numel, 2);
+	json->text(", \"table\": ").fixed((double) table_bytes / numel, 2);
+	json->text(", \"heap\": ").fixed((double) heap_bytes / numel, 2);
+	json->text(", \"snapshot\": ").fixed((double) st.st_size / numel, 2).text("},\n");
+	json->text("  \"peak_rss_bytes\": ").fixed(1024.0 * usage.ru_maxrss, 0).text("\n}\n");
+	flush();
 }
-#endif
 
-void log (void)
+/*
+
+checks every aggregation kernel that the host runs against the scalar loop on the same seeded
+columns, for every length up to SELFTEST_LENGTHS (so every tail of the vector loops) and a few
+lengths past the chunk size, starting at each of the first offsets to cover unaligned columns.
+A kernel fails if it differs from the scalar loop by more than the bound documented above the
+kernels, n * DBL_EPSILON of the sum of the magnitudes of the terms. Exits with EXIT_FAILURE on
+the first failure.
+
+*/
+
+void selftest (void)
 {
-	header();
-	code();
-	info();
-	size();
-	avail();
-	cost();
-	kind();
-	sale();
-	count();
-	total();
-	profit();
-	greet();
+	static size_t const lengths[] = {AGG_CHUNK - 1, AGG_CHUNK, AGG_CHUNK + 1, 100003};
+	size_t const numel = 100003 + SELFTEST_OFFSETS;
+	double *count = (double*) Util_Malloc(numel * sizeof(double), M_BUFFER);
+	double *sale = (double*) Util_Malloc(numel * sizeof(double), M_BUFFER);
+	double *cost = (double*) Util_Malloc(numel * sizeof(double), M_BUFFER);
+	if (!count || !sale || !cost) {
+		fprintf(stderr, "selftest: %s\n", strerror(errno));
+		cleanup();
+		exit(EXIT_FAILURE);
+	}
+
+	uint64_t state = _seed_;
+	for (size_t i = 0; i != numel; ++i) {
+		count[i] = 1 + (double) (benchNext(&state) % 50);
+		cost[i] = 0.01 * (double) (1 + benchNext(&state) % 10000000);
+		// a tenth of the items sell at a loss so that the profit terms have both signs
+		sale[i] = cost[i] * ((benchNext(&state) % 10)? 1.5 : 0.8);
+	}
+
+	size_t const checks = SELFTEST_LENGTHS + 1 + sizeof(lengths) / sizeof(lengths[0]);
+	for (size_t k = 1; k < _kernels_numel_; ++k) {
+		double worst = 0;
+		for (size_t off = 0; off != SELFTEST_OFFSETS; ++off) {
+			for (size_t c = 0; c != checks; ++c) {
+				size_t const n = (c <= SELFTEST_LENGTHS)? c : lengths[c - SELFTEST_LENGTHS - 1];
+				double p = 0;
+				double e = 0;
+				double vp = 0;
+				double ve = 0;
+				agg_scalar(count + off, sale + off, cost + off, n, &p, &e);
+				_kernels_[k].kernel(count + off, sale + off, cost + off, n, &vp, &ve);
+
+				double mp = 0;
+				double me = 0;
+				for (size_t i = off; i != off + n; ++i) {
+					mp += fabs(count[i] * (sale[i] - cost[i]));
+					me += fabs(count[i] * cost[i]);
+				}
+
+				double const bound = ((n)? n : 1) * DBL_EPSILON;
+				if (fabs(vp - p) > bound * mp || fabs(ve - e) > bound * me) {
+					fprintf(stderr,
+						"selftest: %s differs from scalar at length %zu offset %zu\n",
+						_kernels_[k].name, n, off);
+					cleanup();
+					exit(EXIT_FAILURE);
+				}
+
+				if (mp > 0 && fabs(vp - p) / mp > worst) {
+					worst = fabs(vp - p) / mp;
+				}
+				if (me > 0 && fabs(ve - e) / me > worst) {
+					worst = fabs(ve - e) / me;
+				}
+			}
+		}
+		printf("SELFTEST %s: OK (MAX RELATIVE ERROR %.3e)\n", _kernels_[k].name, worst);
+	}
+	printf("SELFTEST KERNELS: %zu\n", _kernels_numel_);
+
+	count = (double*) Util_Free(count);
+	sale = (double*) Util_Free(sale);
+	cost = (double*) Util_Free(cost);
 }
 
 /*
@@ -1372,5 +7822,10 @@ References:
 
 [0] https://en.cppreference.com/w/cpp
 [1] https://www.man7.org/linux/man-pages/man3/system.3.html
+[2] https://www.intel.com/content/www/us/en/docs/intrinsics-guide/index.html
+[3] https://www.man7.org/linux/man-pages/man2/madvise.2.html
+[4] https://www.man7.org/linux/man-pages/man2/mmap.2.html
+[5] https://github.com/fastfloat/fast_float
+[6] https://en.wikipedia.org/wiki/Kahan_summation_algorithm
 
 */